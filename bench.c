@@ -0,0 +1,1480 @@
+/* garray.c goes first, it asks for the features it needs before any system header */
+#include "garray.c"
+#include "garray.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+
+GARRAY_DECLARE(int)
+GARRAY_IMPLEMENT(int)
+
+typedef int int_inline;
+GARRAY_IMPLEMENT_INLINE(int_inline)
+
+typedef struct {
+    double x, y, z;
+    int id;
+} particle;
+GARRAY_IMPLEMENT(particle)
+
+typedef particle particle_inline;
+GARRAY_IMPLEMENT_INLINE(particle_inline)
+
+GARRAY_IMPLEMENT(uint32_t)
+GARRAY_IMPLEMENT(int64_t)
+GARRAY_IMPLEMENT(double)
+
+static int
+int_ascending(int const* left, int const* right)
+{
+    return (*left > *right) - (*left < *right);
+}
+
+static int
+particle_ascending(particle const* left, particle const* right)
+{
+    return (left->id > right->id) - (left->id < right->id);
+}
+
+#define ASCENDING(DATA_TYPE)                                                                       \
+    static int DATA_TYPE##_ascending(DATA_TYPE const* left, DATA_TYPE const* right)                \
+    {                                                                                              \
+        return (*left > *right) - (*left < *right);                                                \
+    }                                                                                              \
+                                                                                                   \
+    GARRAY_IMPLEMENT_SORT(DATA_TYPE, ascending, DATA_TYPE##_ascending)
+
+GARRAY_IMPLEMENT_SORT(int, ascending, int_ascending)
+GARRAY_IMPLEMENT_SORT(particle, ascending, particle_ascending)
+ASCENDING(uint32_t)
+ASCENDING(int64_t)
+ASCENDING(double)
+
+static double
+now_seconds(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Keeps the compiler from optimizing away the benchmarked loops */
+static volatile long long bench_sink;
+
+static bool
+bench_selected(int argc, char** argv, const char* name)
+{
+    if (argc < 2)
+        return true;
+
+    for (int i = 1; i < argc; i++)
+        if (strcmp(argv[i], name) == 0)
+            return true;
+
+    return false;
+}
+
+static garray_int
+sparse_int_array(garray_index capacity, garray_index num_setted)
+{
+    garray_int a = garray_int_new_preallocated(capacity);
+    garray_index step = capacity / num_setted;
+
+    for (garray_index i = 0; i < num_setted; i++)
+        garray_int_set(a, i * step, (int)i);
+
+    return a;
+}
+
+static void
+bench_iteration(void)
+{
+    const garray_index num_setted = 1 << 16;
+
+    printf("iteration: %u setted elements, growing capacity\n", num_setted);
+
+    for (garray_index capacity = 1 << 20; capacity <= 1 << 24; capacity <<= 1) {
+        garray_int a = sparse_int_array(capacity, num_setted);
+        long long sum = 0;
+        const int rounds = 20;
+
+        double start = now_seconds();
+
+        for (int r = 0; r < rounds; r++)
+            for (garray_int_iter it = garray_int_iter_new(a); garray_int_iter_condition_free(it);
+                 garray_int_iter_next(it))
+                sum += *garray_int_iter_get(it);
+
+        double elapsed = (now_seconds() - start) / rounds;
+
+        bench_sink = sum;
+        printf("  capacity %9u: %8.3f ms, %6.2f ns/element, %6.3f ns/slot\n", capacity,
+               elapsed * 1e3, elapsed * 1e9 / num_setted, elapsed * 1e9 / capacity);
+
+        garray_int_free(a);
+    }
+}
+
+static void
+bench_bulk(void)
+{
+    const garray_index num_elements = 10000000;
+    int* data = malloc(num_elements * sizeof(int));
+    garray_index* positions = malloc(num_elements * sizeof(garray_index));
+    long long sum = 0;
+
+    for (garray_index i = 0; i < num_elements; i++) {
+        data[i] = (int)i;
+        positions[i] = (garray_index)(((unsigned long long)i * 2654435761u) % num_elements);
+    }
+
+    printf("bulk: %u ints\n", num_elements);
+
+    double start = now_seconds();
+    garray_int a = garray_int_new();
+
+    for (garray_index i = 0; i < num_elements; i++)
+        garray_int_add(a, data[i]);
+
+    double add = now_seconds() - start;
+
+    garray_int_free(a);
+
+    start = now_seconds();
+    a = garray_int_new();
+    garray_int_add_many(a, data, num_elements);
+
+    double add_many = now_seconds() - start;
+
+    start = now_seconds();
+    int* copy = malloc(num_elements * sizeof(int));
+    memcpy(copy, data, num_elements * sizeof(int));
+
+    double raw = now_seconds() - start;
+
+    bench_sink = copy[num_elements / 2];
+    free(copy);
+
+    printf("  add       %8.2f ms, add_many  %8.2f ms, malloc + memcpy %8.2f ms\n", add * 1e3,
+           add_many * 1e3, raw * 1e3);
+
+    start = now_seconds();
+
+    for (garray_index i = 0; i < num_elements; i++)
+        garray_int_remove(a, i);
+
+    double remove = now_seconds() - start;
+
+    start = now_seconds();
+    garray_int_set_range(a, 0, data, num_elements);
+
+    double set_range = now_seconds() - start;
+
+    start = now_seconds();
+    garray_int_remove_range(a, 0, num_elements);
+
+    double remove_range = now_seconds() - start;
+
+    printf("  remove    %8.2f ms, remove_range %5.2f ms, set_range %8.2f ms\n", remove * 1e3,
+           remove_range * 1e3, set_range * 1e3);
+
+    garray_int_set_range(a, 0, data, num_elements);
+
+    start = now_seconds();
+
+    for (garray_index i = 0; i < num_elements; i++)
+        sum += *garray_int_at(a, positions[i]);
+
+    double at = now_seconds() - start;
+
+    start = now_seconds();
+    garray_int_at_many(a, positions, num_elements, data);
+
+    double at_many = now_seconds() - start;
+
+    printf("  at        %8.2f ms, at_many   %8.2f ms\n", at * 1e3, at_many * 1e3);
+
+    bench_sink = sum + data[num_elements - 1];
+    garray_int_free(a);
+    free(positions);
+    free(data);
+}
+
+static void
+bench_span(void)
+{
+    const garray_index num_elements = 1 << 22;
+    const int rounds = 20;
+
+    printf("span: %u ints, one hole every 1024 slots\n", num_elements);
+
+    garray_int a = garray_int_new_preallocated(num_elements);
+
+    for (garray_index i = 0; i < num_elements; i++)
+        garray_int_add(a, (int)i);
+
+    for (garray_index i = 0; i < num_elements; i += 1024)
+        garray_int_remove(a, i);
+
+    long long sum = 0;
+    double start = now_seconds();
+
+    for (int r = 0; r < rounds; r++)
+        GARRAY_FOREACH(int, a, value)
+        sum += *value;
+
+    double foreach = (now_seconds() - start) / rounds;
+
+    start = now_seconds();
+
+    for (int r = 0; r < rounds; r++) {
+        int const* span;
+
+        for (garray_index position = 0, length;
+             (length = garray_int_next_span(a, &position, &span)) != 0; position += length)
+            for (garray_index i = 0; i < length; i++)
+                sum += span[i];
+    }
+
+    double span = (now_seconds() - start) / rounds;
+
+    printf("  GARRAY_FOREACH %8.3f ms, next_span %8.3f ms\n", foreach * 1e3, span * 1e3);
+
+    bench_sink = sum;
+    garray_int_free(a);
+}
+
+static double
+bench_short_lived(struct garray_allocator const* allocator, garray_arena arena)
+{
+    const int requests = 200, arrays_per_request = 1000;
+    long long sum = 0;
+    double start = now_seconds();
+
+    for (int r = 0; r < requests; r++) {
+        for (int i = 0; i < arrays_per_request; i++) {
+            garray_int a = garray_int_new_with_allocator(allocator);
+
+            for (int j = 0; j < 16 + i % 32; j++)
+                garray_int_add(a, j);
+
+            sum += garray_int_size(a);
+
+            if (arena == NULL)
+                garray_int_free(a);
+        }
+
+        if (arena != NULL)
+            garray_arena_reset(arena);
+    }
+
+    bench_sink = sum;
+
+    return (now_seconds() - start) * 1e9 / (requests * arrays_per_request);
+}
+
+static void
+bench_allocators(void)
+{
+    printf("allocators: short lived arrays of 16 to 47 ints\n");
+
+    double with_malloc = bench_short_lived(NULL, NULL);
+
+    garray_block_pool pool = garray_block_pool_new(256, 1024);
+    double with_pool = bench_short_lived(garray_block_pool_allocator(pool), NULL);
+
+    garray_block_pool_free(pool);
+
+    garray_arena arena = garray_arena_new(1 << 20);
+    double with_arena = bench_short_lived(garray_arena_allocator(arena), arena);
+
+    garray_arena_free(arena);
+
+    printf("  malloc %7.1f ns/array, block pool %7.1f ns/array, arena reset per request %7.1f ns/array\n",
+           with_malloc, with_pool, with_arena);
+}
+
+static void
+bench_random_at(void)
+{
+    const int lookups = 1 << 22;
+    long long sum = 0;
+
+    printf("random_at: garray_int_at() on random positions\n");
+
+    srand(1);
+
+    for (garray_index num_arrays = 1; num_arrays <= 1 << 16; num_arrays <<= 8) {
+        const garray_index num_elements = (1 << 22) / num_arrays;
+        garray_int* arrays = malloc(num_arrays * sizeof(garray_int));
+        garray_index* positions = malloc(lookups * sizeof(garray_index));
+
+        for (garray_index i = 0; i < num_arrays; i++) {
+            arrays[i] = garray_int_new();
+
+            for (garray_index j = 0; j < num_elements; j++)
+                garray_int_add(arrays[i], (int)j);
+        }
+
+        for (int i = 0; i < lookups; i++)
+            positions[i] = (garray_index)rand();
+
+        double start = now_seconds();
+
+        for (int i = 0; i < lookups; i++)
+            sum += *garray_int_at(arrays[positions[i] % num_arrays], positions[i] / num_arrays % num_elements);
+
+        double elapsed = now_seconds() - start;
+
+        printf("  %5u arrays of %7u ints: %6.2f ns/at\n", num_arrays, num_elements,
+               elapsed * 1e9 / lookups);
+
+        for (garray_index i = 0; i < num_arrays; i++)
+            garray_int_free(arrays[i]);
+
+        free(positions);
+        free(arrays);
+    }
+
+    bench_sink = sum;
+}
+
+static void
+bench_small(void)
+{
+    const int num_arrays = 2000000;
+    long long sum = 0;
+
+    printf("small: create, fill with 1 to 7 ints and free\n");
+
+    double start = now_seconds();
+
+    for (int i = 0; i < num_arrays; i++) {
+        garray_int a = garray_int_new();
+
+        for (int j = 0; j <= i % 7; j++)
+            garray_int_add(a, j);
+
+        sum += garray_int_size(a);
+        garray_int_free(a);
+    }
+
+    printf("  %6.1f ns/array\n", (now_seconds() - start) * 1e9 / num_arrays);
+
+    bench_sink = sum;
+}
+
+/* Fills a, sums it with GARRAY_FOREACH and removes random elements, in ns per element */
+static void
+bench_fill_scan_remove(garray_int a, const char* name)
+{
+    const int num_elements = 1 << 22;
+    long long sum = 0;
+
+    double start = now_seconds();
+
+    for (int i = 0; i < num_elements; i++)
+        garray_int_add(a, i);
+
+    double added = now_seconds();
+
+    for (int pass = 0; pass < 8; pass++)
+        GARRAY_FOREACH(int, a, value)
+            sum += *value;
+
+    double scanned = now_seconds();
+
+    srand(1);
+
+    for (int i = 0; i < num_elements / 2; i++)
+        garray_int_remove(a, (garray_index)rand() % (num_elements - i));
+
+    double removed = now_seconds();
+
+    for (int pass = 0; pass < 8; pass++)
+        GARRAY_FOREACH(int, a, value)
+            sum += *value;
+
+    printf("  %-6s add %5.2f ns, foreach %5.2f ns, remove %5.2f ns, foreach after removing %5.2f ns\n", name,
+           (added - start) * 1e9 / num_elements, (scanned - added) * 1e9 / (8.0 * num_elements),
+           (removed - scanned) * 1e9 / (num_elements / 2), (now_seconds() - removed) * 1e9 / (8.0 * num_elements));
+
+    bench_sink = sum;
+    garray_int_free(a);
+}
+
+static void
+bench_dense(void)
+{
+    printf("dense: 4M ints added, summed, half removed at random and summed again\n");
+
+    bench_fill_scan_remove(garray_int_new(), "holes");
+    bench_fill_scan_remove(garray_int_new_dense(), "dense");
+}
+
+/* Allocator that keeps count of the bytes in use and their peak */
+struct counting {
+    size_t in_use;
+    size_t peak;
+};
+
+static void
+counting_add(struct counting* counting, size_t size)
+{
+    counting->in_use += size;
+
+    if (counting->in_use > counting->peak)
+        counting->peak = counting->in_use;
+}
+
+static void*
+counting_allocate(void* context, size_t size)
+{
+    counting_add(context, size);
+
+    return malloc(size);
+}
+
+static void*
+counting_reallocate(void* context, void* ptr, size_t old_size, size_t new_size)
+{
+    ((struct counting*)context)->in_use -= old_size;
+    counting_add(context, new_size);
+
+    return realloc(ptr, new_size);
+}
+
+static void
+counting_deallocate(void* context, void* ptr, size_t size)
+{
+    ((struct counting*)context)->in_use -= size;
+    free(ptr);
+}
+
+/* Sets num_ids ids below max_id, reads them back and walks them, in ns per id */
+static void
+bench_ids(garray_int a, const char* name, struct counting* counting, int num_ids, garray_index max_id)
+{
+    garray_index* ids = malloc(num_ids * sizeof(garray_index));
+    long long sum = 0;
+
+    srand(1);
+
+    for (int i = 0; i < num_ids; i++)
+        ids[i] = (garray_index)(((unsigned long long)rand() << 16 ^ (unsigned long long)rand()) % max_id);
+
+    double start = now_seconds();
+
+    for (int i = 0; i < num_ids; i++)
+        garray_int_set(a, ids[i], i);
+
+    double setted = now_seconds();
+
+    for (int i = 0; i < num_ids; i++)
+        sum += *garray_int_at(a, ids[i]);
+
+    double read = now_seconds();
+
+    GARRAY_FOREACH(int, a, value)
+        sum += *value;
+
+    printf("  %-5s set %6.1f ns, at %5.1f ns, foreach %6.1f ns, peak memory %7.2f MB\n", name,
+           (setted - start) * 1e9 / num_ids, (read - setted) * 1e9 / num_ids,
+           (now_seconds() - read) * 1e9 / num_ids, counting->peak / 1e6);
+
+    bench_sink = sum;
+    garray_int_free(a);
+    free(ids);
+}
+
+static void
+bench_paged(void)
+{
+    struct counting flat_counting = { 0 }, paged_counting = { 0 };
+    struct garray_allocator flat_allocator = { counting_allocate, counting_reallocate, counting_deallocate,
+                                               &flat_counting };
+    struct garray_allocator paged_allocator = { counting_allocate, counting_reallocate, counting_deallocate,
+                                                &paged_counting };
+
+    printf("paged: 100000 random ids below 2^24\n");
+    bench_ids(garray_int_new_with_allocator(&flat_allocator), "flat", &flat_counting, 100000, 1 << 24);
+
+    garray_int paged = ___garray_new_paged(sizeof(int), &paged_allocator);
+    bench_ids(paged, "paged", &paged_counting, 100000, 1 << 24);
+
+    /* A flat array would need more than 16 GB */
+    paged_counting = (struct counting) { 0 };
+    printf("paged: 10000 random ids below 2^32 - 1\n");
+    bench_ids(___garray_new_paged(sizeof(int), &paged_allocator), "paged", &paged_counting, 10000,
+              GARRAY_MAX_VALUE);
+}
+
+/* Adds elements one by one keeping the slowest add, then reads and walks them, in ns per element */
+static void
+bench_growth(garray_int a, const char* name)
+{
+    const int elements = 1 << 24;
+    double slowest = 0;
+    long long sum = 0;
+
+    double start = now_seconds();
+
+    for (int i = 0; i < elements; i++) {
+        double before = now_seconds();
+
+        garray_int_add(a, i);
+
+        if (now_seconds() - before > slowest)
+            slowest = now_seconds() - before;
+    }
+
+    double added = now_seconds();
+
+    for (int i = 0; i < elements; i++)
+        sum += *garray_int_at(a, i);
+
+    double read = now_seconds();
+
+    GARRAY_FOREACH(int, a, value)
+        sum += *value;
+
+    printf("  %-9s add %5.1f ns (slowest %8.1f us), at %4.1f ns, foreach %4.1f ns\n", name,
+           (added - start) * 1e9 / elements, slowest * 1e6, (read - added) * 1e9 / elements,
+           (now_seconds() - read) * 1e9 / elements);
+
+    bench_sink = sum;
+    garray_int_free(a);
+}
+
+/* Clones an array of num_elements ints and writes to num_writes random positions of the original */
+static void
+bench_snapshot_of(garray_int a, const char* name, garray_index num_elements, garray_index num_writes)
+{
+    for (garray_index i = 0; i < num_elements; i++)
+        garray_int_add(a, (int)i);
+
+    double start = now_seconds();
+    garray_int snapshot = garray_int_clone(a);
+    double cloned = now_seconds();
+
+    for (garray_index i = 0; i < num_writes; i++)
+        garray_int_set(a, (garray_index)(((unsigned long long)i * 2654435761u) % num_elements), -1);
+
+    double written = now_seconds();
+
+    printf("  %-6s clone %9.2f us, %u writes after it %9.2f us\n", name, (cloned - start) * 1e6, num_writes,
+           (written - cloned) * 1e6);
+
+    bench_sink = garray_int_size(snapshot);
+    garray_int_free(snapshot);
+    garray_int_free(a);
+}
+
+static void
+bench_snapshot(void)
+{
+    const garray_index num_elements = 1 << 24;
+
+    printf("snapshot: clone of %u ints and writes to the original after it\n", num_elements);
+
+    for (garray_index num_writes = 16; num_writes <= 16384; num_writes <<= 5) {
+        bench_snapshot_of(garray_int_new(), "flat", num_elements, num_writes);
+        bench_snapshot_of(garray_int_new_paged(), "paged", num_elements, num_writes);
+    }
+}
+
+static void
+bench_segmented(void)
+{
+    printf("segmented: 16M ints added one by one, read and walked\n");
+
+    bench_growth(garray_int_new(), "flat");
+    bench_growth(garray_int_new_segmented(), "segmented");
+}
+
+/* Grows an array to num_elements ints one add at a time, then reads them at random positions */
+static void
+bench_large(garray_int a, const char* name, garray_index num_elements)
+{
+    garray_index* positions = malloc(num_elements * sizeof(garray_index));
+    long long sum = 0;
+
+    for (garray_index i = 0; i < num_elements; i++)
+        positions[i] = (garray_index)(((unsigned long long)i * 2654435761u) % num_elements);
+
+    double start = now_seconds();
+
+    for (garray_index i = 0; i < num_elements; i++)
+        garray_int_add(a, (int)i);
+
+    double added = now_seconds();
+
+    for (garray_index i = 0; i < num_elements; i++)
+        sum += *garray_int_at(a, positions[i]);
+
+    double read = now_seconds();
+
+    garray_int_remove_range(a, 1, num_elements);
+    garray_int_collapse(a);
+
+    printf("  %-6s add %5.2f ns, random at %5.2f ns, remove and collapse %7.2f ms\n", name,
+           (added - start) * 1e9 / num_elements, (read - added) * 1e9 / num_elements,
+           (now_seconds() - read) * 1e3);
+
+    bench_sink = sum;
+    garray_int_free(a);
+    free(positions);
+}
+
+static void
+bench_mapped(void)
+{
+    const garray_index num_elements = 1 << 25;
+    struct counting counting = { 0 };
+    struct garray_allocator malloc_only = { counting_allocate, counting_reallocate, counting_deallocate,
+                                            &counting };
+
+    printf("mapped: %u ints added one by one, read at random and collapsed\n", num_elements);
+
+    bench_large(garray_int_new_with_allocator(&malloc_only), "malloc", num_elements);
+    bench_large(garray_int_new(), "mapped", num_elements);
+}
+
+static void
+bench_open(void)
+{
+    const garray_index num_elements = 1 << 24;
+    const char* path = "bench.garray";
+    long long sum = 0;
+
+    printf("open: %u ints rebuilt against saved and mapped back\n", num_elements);
+
+    double start = now_seconds();
+    garray_int a = garray_int_new();
+
+    for (garray_index i = 0; i < num_elements; i++)
+        garray_int_add(a, (int)i);
+
+    double built = now_seconds();
+
+    garray_save(a, path);
+    garray_int_free(a);
+
+    double saved = now_seconds();
+
+    a = garray_int_open_mmap(path, GARRAY_MAP_READONLY);
+    sum += *garray_int_at(a, num_elements / 2);
+
+    double opened = now_seconds();
+
+    GARRAY_FOREACH(int, a, value)
+        sum += *value;
+
+    double walked = now_seconds();
+
+    printf("  rebuild %7.2f ms, save %7.2f ms, open and first at %7.3f ms, then foreach %7.2f ms\n",
+           (built - start) * 1e3, (saved - built) * 1e3, (opened - saved) * 1e3, (walked - opened) * 1e3);
+
+    bench_sink = sum;
+    garray_int_free(a);
+    remove(path);
+}
+
+/* Writes a to a stream and reads it back, against a raw fwrite() of its whole block */
+static void
+bench_stream_of(garray_int a, const char* name)
+{
+    const size_t block = (size_t)a->capacity * a->element_size;
+    const double elements_mb = (double)garray_int_size(a) * sizeof(int) / 1e6;
+    FILE *raw_file = tmpfile(), *file = tmpfile();
+
+    double start = now_seconds();
+
+    fwrite(a->array, 1, block, raw_file);
+    fflush(raw_file);
+
+    double raw = now_seconds();
+
+    garray_write(a, file);
+    fflush(file);
+
+    double written = now_seconds();
+    const long stream_size = ftell(file);
+
+    rewind(file);
+    garray_int b = garray_int_read(file);
+
+    double read = now_seconds();
+
+    printf("  %-7s fwrite %8.1f MB in %7.2f ms (%7.0f MB/s of elements), write %8.1f MB in %7.2f ms (%7.0f MB/s), "
+           "read %7.2f ms (%7.0f MB/s)\n",
+           name, block / 1e6, (raw - start) * 1e3, elements_mb / (raw - start), stream_size / 1e6,
+           (written - raw) * 1e3, elements_mb / (written - raw), (read - written) * 1e3, elements_mb / (read - written));
+
+    bench_sink = garray_int_size(b);
+    garray_int_free(b);
+    fclose(raw_file);
+    fclose(file);
+}
+
+static void
+bench_stream(void)
+{
+    const garray_index num_elements = 1 << 24;
+    garray_int a = garray_int_new();
+
+    printf("stream: %u ints written to a temporary file, full and after removes\n", num_elements);
+
+    for (garray_index i = 0; i < num_elements; i++)
+        garray_int_add(a, (int)i);
+
+    bench_stream_of(a, "full");
+
+    /* Three of every four elements removed in runs, and every element of a random one in 64 */
+    for (garray_index i = 0; i < num_elements; i += 1024)
+        garray_int_remove_range(a, i + 256, 768);
+
+    bench_stream_of(a, "runs");
+
+    srand(1);
+
+    for (garray_index i = 0; i < num_elements; i++)
+        if (rand() % 64 != 0)
+            garray_int_remove(a, i);
+
+    bench_stream_of(a, "random");
+
+    garray_int_free(a);
+}
+
+/* A producer of bench_concurrent(), adds its share of elements and removes one in four */
+struct producer {
+    garray_int a;
+    pthread_mutex_t* mutex; //NULL for a concurrent array
+    garray_index num_elements;
+};
+
+static void*
+produce(void* data)
+{
+    struct producer* producer = data;
+
+    for (garray_index i = 0; i < producer->num_elements; i++) {
+        if (producer->mutex != NULL)
+            pthread_mutex_lock(producer->mutex);
+
+        garray_index position = garray_int_add(producer->a, (int)i);
+
+        if (i % 4 == 0)
+            garray_int_remove(producer->a, position);
+
+        if (producer->mutex != NULL)
+            pthread_mutex_unlock(producer->mutex);
+    }
+
+    return NULL;
+}
+
+static double
+bench_producers(garray_int a, pthread_mutex_t* mutex, int num_threads, garray_index num_elements)
+{
+    pthread_t threads[16];
+    struct producer producer = { a, mutex, num_elements / num_threads };
+    double start = now_seconds();
+
+    for (int i = 0; i < num_threads; i++)
+        pthread_create(&threads[i], NULL, produce, &producer);
+
+    for (int i = 0; i < num_threads; i++)
+        pthread_join(threads[i], NULL);
+
+    double elapsed = now_seconds() - start;
+
+    bench_sink = garray_int_size(a);
+    garray_int_free(a);
+
+    return elapsed;
+}
+
+static void
+bench_concurrent(void)
+{
+    const garray_index num_elements = 1 << 22;
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+    printf("concurrent: %u ints added by N threads, one in four removed, against a mutex around a flat array\n",
+           num_elements);
+
+    for (int num_threads = 1; num_threads <= 16; num_threads <<= 1) {
+        double locked = bench_producers(garray_int_new(), &mutex, num_threads, num_elements);
+        double concurrent = bench_producers(garray_int_new_concurrent(), NULL, num_threads, num_elements);
+
+        printf("  %2i threads: mutex %8.2f ns/add, concurrent %8.2f ns/add\n", num_threads,
+               locked * 1e9 / num_elements, concurrent * 1e9 / num_elements);
+    }
+}
+
+/* An appender of bench_sharded(), adds its share of elements to a shared array or to its own shard */
+struct appender {
+    garray_int a;
+    garray_sharded sharded; //NULL to add to a
+    garray_index num_elements;
+};
+
+static void*
+append(void* data)
+{
+    struct appender* appender = data;
+    garray_int a = appender->sharded != NULL ? garray_int_sharded_shard(appender->sharded) : appender->a;
+
+    for (garray_index i = 0; i < appender->num_elements; i++)
+        garray_int_add(a, (int)i);
+
+    return NULL;
+}
+
+static void
+bench_sharded(void)
+{
+    const garray_index num_elements = 1 << 22;
+
+    printf("sharded: %u ints appended by N threads to their shards then merged, against a concurrent array\n",
+           num_elements);
+
+    for (int num_threads = 1; num_threads <= 16; num_threads <<= 1) {
+        garray_int concurrent = garray_int_new_concurrent();
+        garray_sharded sharded = garray_int_new_sharded();
+        struct appender appender = { concurrent, NULL, num_elements / num_threads };
+        pthread_t threads[16];
+        double start = now_seconds();
+
+        for (int i = 0; i < num_threads; i++)
+            pthread_create(&threads[i], NULL, append, &appender);
+        for (int i = 0; i < num_threads; i++)
+            pthread_join(threads[i], NULL);
+
+        double shared = now_seconds() - start;
+
+        appender.sharded = sharded;
+        start = now_seconds();
+        for (int i = 0; i < num_threads; i++)
+            pthread_create(&threads[i], NULL, append, &appender);
+        for (int i = 0; i < num_threads; i++)
+            pthread_join(threads[i], NULL);
+
+        double appended = now_seconds() - start;
+
+        start = now_seconds();
+        garray_int merged = garray_int_sharded_merge(sharded);
+        double merge = now_seconds() - start;
+
+        bench_sink = garray_int_size(merged) + garray_int_size(concurrent);
+        printf("  %2i threads: concurrent %6.2f ns/add, sharded %6.2f ns/add + merge %6.2f ns/element\n",
+               num_threads, shared * 1e9 / num_elements, appended * 1e9 / num_elements, merge * 1e9 / num_elements);
+
+        garray_int_free(merged);
+        garray_int_free(concurrent);
+        garray_sharded_free(sharded);
+    }
+}
+
+static void
+bench_churn(void)
+{
+    const int operations = 1 << 16;
+
+    printf("churn: remove a random slot and add again on a full array\n");
+
+    srand(1);
+
+    for (garray_index num_elements = 1 << 16; num_elements <= 1 << 22; num_elements <<= 2) {
+        garray_int a = garray_int_new();
+
+        for (garray_index i = 0; i < num_elements; i++)
+            garray_int_add(a, (int)i);
+
+        double start = now_seconds();
+
+        for (int i = 0; i < operations; i++) {
+            garray_int_remove(a, (garray_index)rand() % num_elements);
+            garray_int_add(a, i);
+        }
+
+        double elapsed = now_seconds() - start;
+
+        printf("  %9u elements: %8.2f ns/remove+add\n", num_elements, elapsed * 1e9 / operations);
+
+        garray_int_free(a);
+    }
+}
+
+/* An array of num_elements ints with one in two removed at random */
+static garray_int
+bench_holes(garray_index num_elements)
+{
+    garray_int a = garray_int_new();
+
+    srand(1);
+
+    for (garray_index i = 0; i < num_elements; i++)
+        garray_int_add(a, (int)i);
+
+    for (garray_index i = 0; i < num_elements; i++)
+        if (rand() % 2)
+            garray_int_remove(a, i);
+
+    return a;
+}
+
+/* Removes num_removes random elements, compacting the whole array every compact_every removes if not 0 */
+static void
+bench_compact_pauses(garray_int a, const char* name, garray_index num_removes, garray_index compact_every)
+{
+    double slowest = 0, start = now_seconds();
+
+    for (garray_index i = 1; i <= num_removes; i++) {
+        double before = now_seconds();
+
+        garray_int_remove(a, (garray_index)rand() % garray_int_size(a));
+
+        if (compact_every != 0 && i % compact_every == 0)
+            garray_int_compact(a);
+
+        if (now_seconds() - before > slowest)
+            slowest = now_seconds() - before;
+    }
+
+    printf("  %-24s %7.2f ns/remove, slowest %9.2f us\n", name, (now_seconds() - start) * 1e9 / num_removes,
+           slowest * 1e6);
+
+    bench_sink = garray_int_size(a);
+    garray_int_free(a);
+}
+
+static void
+bench_compact(void)
+{
+    const garray_index num_elements = 1 << 22;
+
+    printf("compact: %u ints with half of them removed\n", num_elements);
+
+    garray_int a = bench_holes(num_elements);
+    double start = now_seconds();
+
+    garray_int_collapse(a);
+    printf("  collapse %7.2f ms,", (now_seconds() - start) * 1e3);
+    garray_int_free(a);
+
+    a = bench_holes(num_elements);
+    start = now_seconds();
+    garray_int_compact(a);
+    printf(" stable compact %7.2f ms,", (now_seconds() - start) * 1e3);
+    garray_int_free(a);
+
+    a = bench_holes(num_elements);
+    start = now_seconds();
+
+    for (garray_index steps = 1;; steps++)
+        if (garray_int_compact_step(a, 4096)) {
+            printf(" in steps of 4096 %7.2f ms, %u steps\n", (now_seconds() - start) * 1e3, steps);
+            break;
+        }
+
+    garray_int_free(a);
+
+    printf("compact: random removes from %u ints until half are left\n", num_elements);
+
+    a = bench_holes(num_elements);
+    garray_int_compact(a);
+    bench_compact_pauses(a, "compact every 1/8", num_elements / 4, num_elements / 32);
+
+    a = bench_holes(num_elements);
+    garray_int_compact(a);
+    garray_int_set_auto_compaction(a, 0.25, 64);
+    bench_compact_pauses(a, "auto at 25%, 64 a step", num_elements / 4, 0);
+}
+
+/* Times add, at, set and iteration over num_elements elements of DATA_TYPE, VALUE(i) builds the i-th element */
+#define BENCH_HOT_PATHS(DATA_TYPE, VALUE, KEY)                                                     \
+    static void                                                                                    \
+    bench_hot_paths_##DATA_TYPE(garray_index num_elements)                                         \
+    {                                                                                              \
+        garray_##DATA_TYPE a = garray_##DATA_TYPE##_new();                                         \
+        long long sum = 0;                                                                         \
+        double times[4], start = now_seconds();                                                    \
+                                                                                                   \
+        for (garray_index i = 0; i < num_elements; i++)                                            \
+            garray_##DATA_TYPE##_add(a, VALUE(i));                                                 \
+                                                                                                   \
+        times[0] = now_seconds();                                                                  \
+                                                                                                   \
+        for (garray_index i = 0; i < num_elements; i++)                                            \
+            sum += KEY(*garray_##DATA_TYPE##_at(a, i));                                            \
+                                                                                                   \
+        times[1] = now_seconds();                                                                  \
+                                                                                                   \
+        for (garray_index i = 0; i < num_elements; i++)                                            \
+            garray_##DATA_TYPE##_set(a, i, VALUE(i + 1));                                          \
+                                                                                                   \
+        times[2] = now_seconds();                                                                  \
+                                                                                                   \
+        for (garray_##DATA_TYPE##_iter it = garray_##DATA_TYPE##_iter_new(a);                      \
+             garray_##DATA_TYPE##_iter_condition_free(it); garray_##DATA_TYPE##_iter_next(it))     \
+            sum += KEY(*garray_##DATA_TYPE##_iter_get(it));                                        \
+                                                                                                   \
+        times[3] = now_seconds();                                                                  \
+        bench_sink = sum;                                                                          \
+                                                                                                   \
+        printf("  %-16s add %6.2f  at %6.2f  set %6.2f  iter %6.2f ns/element\n", #DATA_TYPE,      \
+               (times[0] - start) * 1e9 / num_elements,                                            \
+               (times[1] - times[0]) * 1e9 / num_elements,                                         \
+               (times[2] - times[1]) * 1e9 / num_elements,                                         \
+               (times[3] - times[2]) * 1e9 / num_elements);                                        \
+                                                                                                   \
+        garray_##DATA_TYPE##_free(a);                                                              \
+    }
+
+#define INT_VALUE(i) ((int)(i))
+#define INT_KEY(value) (value)
+#define PARTICLE_VALUE(i) ((particle){ (double)(i), 0.5, 0.25, (int)(i) })
+#define PARTICLE_KEY(value) ((value).id)
+
+BENCH_HOT_PATHS(int, INT_VALUE, INT_KEY)
+BENCH_HOT_PATHS(int_inline, INT_VALUE, INT_KEY)
+BENCH_HOT_PATHS(particle, PARTICLE_VALUE, PARTICLE_KEY)
+BENCH_HOT_PATHS(particle_inline, PARTICLE_VALUE, PARTICLE_KEY)
+
+static void
+bench_inline(void)
+{
+    const garray_index num_elements = 1 << 22;
+
+    printf("inline: GARRAY_IMPLEMENT against GARRAY_IMPLEMENT_INLINE, %u elements\n", num_elements);
+
+    bench_hot_paths_int(num_elements);
+    bench_hot_paths_int_inline(num_elements);
+    bench_hot_paths_particle(num_elements);
+    bench_hot_paths_particle_inline(num_elements);
+}
+
+static garray_int
+random_int_array(garray_index num_elements)
+{
+    garray_int a = garray_int_new_preallocated(num_elements);
+
+    srand(1);
+
+    for (garray_index i = 0; i < num_elements; i++)
+        garray_int_add(a, rand());
+
+    return a;
+}
+
+static garray_particle
+random_particle_array(garray_index num_elements)
+{
+    garray_particle a = garray_particle_new_preallocated(num_elements);
+
+    srand(1);
+
+    for (garray_index i = 0; i < num_elements; i++)
+        garray_particle_add(a, PARTICLE_VALUE(rand()));
+
+    return a;
+}
+
+#define BENCH_SORT_RESULT(name, elapsed, sorted, free_function)                                    \
+    printf("  %-40s %8.2f ms\n", name, (elapsed) * 1e3);                                           \
+    free_function(sorted)
+
+static void
+bench_sort(void)
+{
+    const garray_index num_elements = 1 << 22;
+    garray_int a = random_int_array(num_elements);
+    garray_particle p = random_particle_array(num_elements);
+    double start;
+
+    printf("sort: %u random elements\n", num_elements);
+
+    start = now_seconds();
+    garray_int sorted = ___garray_sort(a, (int (*)(void const*, void const*))int_ascending);
+    BENCH_SORT_RESULT("int qsort", now_seconds() - start, sorted, garray_int_free);
+
+    start = now_seconds();
+    sorted = garray_int_sort(a, int_ascending);
+    BENCH_SORT_RESULT("int garray_int_sort", now_seconds() - start, sorted, garray_int_free);
+
+    start = now_seconds();
+    sorted = garray_int_sort_ascending(a);
+    BENCH_SORT_RESULT("int garray_int_sort_ascending (inlined)", now_seconds() - start, sorted,
+                      garray_int_free);
+
+    sorted = garray_int_clone(a);
+    start = now_seconds();
+    garray_int_sort_inplace_ascending(sorted);
+    BENCH_SORT_RESULT("int garray_int_sort_inplace_ascending", now_seconds() - start, sorted,
+                      garray_int_free);
+
+    start = now_seconds();
+    garray_particle sorted_p = ___garray_sort(p, (int (*)(void const*, void const*))particle_ascending);
+    BENCH_SORT_RESULT("particle qsort", now_seconds() - start, sorted_p, garray_particle_free);
+
+    start = now_seconds();
+    sorted_p = garray_particle_sort(p, particle_ascending);
+    BENCH_SORT_RESULT("particle garray_particle_sort", now_seconds() - start, sorted_p,
+                      garray_particle_free);
+
+    start = now_seconds();
+    sorted_p = garray_particle_sort_ascending(p);
+    BENCH_SORT_RESULT("particle garray_particle_sort_ascending", now_seconds() - start, sorted_p,
+                      garray_particle_free);
+
+    garray_int_free(a);
+    garray_particle_free(p);
+}
+
+static uint64_t
+particle_key(particle const* element)
+{
+    return garray_radix_key_i32(element->id);
+}
+
+/* Times qsort, the inlined introsort and the radix sort on num_elements random DATA_TYPE */
+#define BENCH_RADIX(DATA_TYPE, KEY, RANDOM)                                                        \
+    static void                                                                                    \
+    bench_radix_##DATA_TYPE(garray_index num_elements)                                             \
+    {                                                                                              \
+        garray_##DATA_TYPE a = garray_##DATA_TYPE##_new_preallocated(num_elements), sorted;        \
+        double start;                                                                              \
+                                                                                                   \
+        srand(1);                                                                                  \
+                                                                                                   \
+        for (garray_index i = 0; i < num_elements; i++)                                            \
+            garray_##DATA_TYPE##_add(a, RANDOM);                                                   \
+                                                                                                   \
+        start = now_seconds();                                                                     \
+        sorted = ___garray_sort(a, (int (*)(void const*, void const*))DATA_TYPE##_ascending);      \
+        BENCH_SORT_RESULT(#DATA_TYPE " qsort", now_seconds() - start, sorted,                      \
+                          garray_##DATA_TYPE##_free);                                              \
+                                                                                                   \
+        start = now_seconds();                                                                     \
+        sorted = garray_##DATA_TYPE##_sort_ascending(a);                                           \
+        BENCH_SORT_RESULT(#DATA_TYPE " introsort (inlined)", now_seconds() - start, sorted,        \
+                          garray_##DATA_TYPE##_free);                                              \
+                                                                                                   \
+        start = now_seconds();                                                                     \
+        sorted = garray_##DATA_TYPE##_sort_radix(a, KEY, 0);                                       \
+        BENCH_SORT_RESULT(#DATA_TYPE " radix", now_seconds() - start, sorted,                      \
+                          garray_##DATA_TYPE##_free);                                              \
+                                                                                                   \
+        garray_##DATA_TYPE##_free(a);                                                              \
+    }
+
+BENCH_RADIX(uint32_t, GARRAY_RADIX_U32, (uint32_t)rand() * 2654435761u)
+BENCH_RADIX(int64_t, GARRAY_RADIX_I64, (int64_t)(((uint64_t)rand() << 33) ^ (uint64_t)rand()))
+BENCH_RADIX(double, GARRAY_RADIX_F64, (rand() - RAND_MAX / 2) * 1e-3)
+
+static void
+bench_radix(void)
+{
+    const garray_index num_elements = 1 << 22;
+    garray_particle p = random_particle_array(num_elements), sorted;
+    double start;
+
+    printf("radix: %u random elements\n", num_elements);
+
+    bench_radix_uint32_t(num_elements);
+    bench_radix_int64_t(num_elements);
+    bench_radix_double(num_elements);
+
+    start = now_seconds();
+    sorted = garray_particle_sort_ascending(p);
+    BENCH_SORT_RESULT("particle introsort (inlined)", now_seconds() - start, sorted,
+                      garray_particle_free);
+
+    start = now_seconds();
+    sorted = garray_particle_sort_radix(p, GARRAY_RADIX_I32, offsetof(particle, id));
+    BENCH_SORT_RESULT("particle radix by field", now_seconds() - start, sorted, garray_particle_free);
+
+    start = now_seconds();
+    sorted = garray_particle_sort_radix_by(p, particle_key);
+    BENCH_SORT_RESULT("particle radix by key function", now_seconds() - start, sorted,
+                      garray_particle_free);
+
+    garray_particle_free(p);
+}
+
+static void
+bench_parallel_sort(void)
+{
+    const garray_index num_elements = 1 << 22;
+    garray_int a = random_int_array(num_elements), sorted;
+    double start = now_seconds(), serial;
+
+    printf("parallel_sort: %u random ints\n", num_elements);
+
+    sorted = garray_int_sort(a, int_ascending);
+    serial = now_seconds() - start;
+    garray_int_free(sorted);
+    printf("  serial garray_int_sort     %8.2f ms\n", serial * 1e3);
+
+    for (unsigned num_threads = 1; num_threads <= 32; num_threads <<= 1) {
+        start = now_seconds();
+        sorted = garray_int_sort_parallel(a, int_ascending, num_threads);
+        double elapsed = now_seconds() - start;
+        garray_int_free(sorted);
+
+        printf("  %2u threads                 %8.2f ms  x%.2f\n", num_threads, elapsed * 1e3,
+               serial / elapsed);
+    }
+
+    garray_int_free(a);
+}
+
+static bool
+int_divisible(int const* value, void* data)
+{
+    return *value % *(int*)data == 0;
+}
+
+static bool
+int_is(int const* value, void* data)
+{
+    return *value == *(int*)data;
+}
+
+static bool
+int_equal(int const* left, int const* right)
+{
+    return *left == *right;
+}
+
+static void
+bench_foreach(void)
+{
+    const garray_index num_elements = 1 << 20;
+    const int rounds = 20;
+    garray_int a = garray_int_new_preallocated(num_elements);
+    long long sum = 0;
+
+    for (garray_index i = 0; i < num_elements; i++)
+        garray_int_add(a, (int)i);
+
+    printf("foreach: %u dense elements\n", num_elements);
+
+    double start = now_seconds();
+
+    for (int r = 0; r < rounds; r++)
+        for (garray_int_iter it = garray_int_iter_new(a); garray_int_iter_condition_free(it);
+             garray_int_iter_next(it))
+            sum += *garray_int_iter_get(it);
+
+    double iter = (now_seconds() - start) / rounds;
+
+    start = now_seconds();
+
+    for (int r = 0; r < rounds; r++)
+        GARRAY_FOREACH(int, a, value)
+        sum += *value;
+
+    double foreach = (now_seconds() - start) / rounds;
+
+    printf("  iterator %8.3f ms, GARRAY_FOREACH %8.3f ms\n", iter * 1e3, foreach * 1e3);
+    garray_int_free(a);
+
+    const int lookups = 1 << 20;
+    garray_int small = garray_int_new();
+
+    for (int i = 0; i < 8; i++)
+        garray_int_add(small, i);
+
+    start = now_seconds();
+
+    for (int i = 0; i < lookups; i++)
+        sum += garray_int_contains(small, i & 15, int_equal);
+
+    printf("  contains on 8 elements: %6.2f ns/lookup\n",
+           (now_seconds() - start) * 1e9 / lookups);
+
+    bench_sink = sum;
+    garray_int_free(small);
+}
+
+static void
+bench_parallel_scan(void)
+{
+    const garray_index num_elements = 1 << 23;
+    garray_int a = random_int_array(num_elements), result;
+    int divisor = 100, missing = -1;
+    double start;
+
+    printf("parallel_scan: %u random ints, query matches 1%%, get and contains match nothing\n",
+           num_elements);
+
+    start = now_seconds();
+    result = garray_int_query(a, &divisor, int_divisible);
+    printf("  serial    query %8.2f ms", (now_seconds() - start) * 1e3);
+    garray_int_free(result);
+
+    start = now_seconds();
+    bench_sink = garray_int_get(a, &missing, int_is) != NULL;
+    printf("  get %8.2f ms", (now_seconds() - start) * 1e3);
+
+    start = now_seconds();
+    bench_sink = garray_int_contains(a, missing, int_equal);
+    printf("  contains %8.2f ms\n", (now_seconds() - start) * 1e3);
+
+    for (unsigned num_threads = 1; num_threads <= 8; num_threads <<= 1) {
+        garray_pool pool = garray_pool_new(num_threads);
+
+        start = now_seconds();
+        result = garray_int_query_parallel(a, &divisor, int_divisible, pool);
+        printf("  %u threads query %8.2f ms", num_threads, (now_seconds() - start) * 1e3);
+        garray_int_free(result);
+
+        start = now_seconds();
+        bench_sink = garray_int_get_parallel(a, &missing, int_is, pool) != NULL;
+        printf("  get %8.2f ms", (now_seconds() - start) * 1e3);
+
+        start = now_seconds();
+        bench_sink = garray_int_contains_parallel(a, missing, int_equal, pool);
+        printf("  contains %8.2f ms\n", (now_seconds() - start) * 1e3);
+
+        garray_pool_free(pool);
+    }
+
+    garray_int_free(a);
+}
+
+/* An array of num_elements ints with holes_per_mille of them removed at random */
+static garray_int
+bench_density(garray_index num_elements, int holes_per_mille)
+{
+    garray_int a = garray_int_new();
+
+    srand(1);
+
+    for (garray_index i = 0; i < num_elements; i++)
+        garray_int_add(a, (int)i);
+
+    for (garray_index i = 0; i < num_elements; i++)
+        if (rand() % 1000 < holes_per_mille)
+            garray_int_remove(a, i);
+
+    return a;
+}
+
+static void
+bench_simd(void)
+{
+    const garray_index num_elements = 1 << 22;
+    const int holes_per_mille[] = { 0, 10, 100, 250, 500, 750, 900, 990 };
+    const int divisor = 1;
+
+    printf("simd: compress kernels on %u ints, %s kernel\n", num_elements,
+           compress_kernel_for(sizeof(int)) == compress_4_avx512 ? "avx512"
+           : compress_kernel_for(sizeof(int)) == compress_4_avx2 ? "avx2"
+                                                                 : "portable");
+
+    for (size_t i = 0; i < sizeof(holes_per_mille) / sizeof(holes_per_mille[0]); i++) {
+        garray_int a = bench_density(num_elements, holes_per_mille[i]);
+        double start = now_seconds();
+
+        compress_array((garray)a, portable_kernel(sizeof(int)));
+        printf("  %5.1f%% holes  portable %7.2f ms", holes_per_mille[i] / 10.0, (now_seconds() - start) * 1e3);
+        garray_int_free(a);
+
+        a = bench_density(num_elements, holes_per_mille[i]);
+        start = now_seconds();
+        compress_array((garray)a, compress_kernel_for(sizeof(int)));
+        printf("  dispatched %7.2f ms", (now_seconds() - start) * 1e3);
+        garray_int_free(a);
+
+        a = bench_density(num_elements, holes_per_mille[i]);
+        start = now_seconds();
+        garray_int_collapse(a);
+        printf("  collapse %7.2f ms", (now_seconds() - start) * 1e3);
+        garray_int_free(a);
+
+        a = bench_density(num_elements, holes_per_mille[i]);
+        start = now_seconds();
+        garray_int result = garray_int_query(a, (void*)&divisor, int_divisible);
+        printf("  query %7.2f ms\n", (now_seconds() - start) * 1e3);
+        garray_int_free(result);
+        garray_int_free(a);
+    }
+}
+
+int
+main(int argc, char** argv)
+{
+    if (bench_selected(argc, argv, "iteration"))
+        bench_iteration();
+
+    if (bench_selected(argc, argv, "foreach"))
+        bench_foreach();
+
+    if (bench_selected(argc, argv, "bulk"))
+        bench_bulk();
+
+    if (bench_selected(argc, argv, "span"))
+        bench_span();
+
+    if (bench_selected(argc, argv, "allocators"))
+        bench_allocators();
+
+    if (bench_selected(argc, argv, "random_at"))
+        bench_random_at();
+
+    if (bench_selected(argc, argv, "small"))
+        bench_small();
+
+    if (bench_selected(argc, argv, "dense"))
+        bench_dense();
+    if (bench_selected(argc, argv, "paged"))
+        bench_paged();
+    if (bench_selected(argc, argv, "snapshot"))
+        bench_snapshot();
+    if (bench_selected(argc, argv, "segmented"))
+        bench_segmented();
+    if (bench_selected(argc, argv, "mapped"))
+        bench_mapped();
+    if (bench_selected(argc, argv, "open"))
+        bench_open();
+    if (bench_selected(argc, argv, "stream"))
+        bench_stream();
+    if (bench_selected(argc, argv, "concurrent"))
+        bench_concurrent();
+    if (bench_selected(argc, argv, "sharded"))
+        bench_sharded();
+    if (bench_selected(argc, argv, "churn"))
+        bench_churn();
+
+    if (bench_selected(argc, argv, "compact"))
+        bench_compact();
+
+    if (bench_selected(argc, argv, "inline"))
+        bench_inline();
+
+    if (bench_selected(argc, argv, "sort"))
+        bench_sort();
+
+    if (bench_selected(argc, argv, "radix"))
+        bench_radix();
+
+    if (bench_selected(argc, argv, "parallel_sort"))
+        bench_parallel_sort();
+
+    if (bench_selected(argc, argv, "parallel_scan"))
+        bench_parallel_scan();
+
+    if (bench_selected(argc, argv, "simd"))
+        bench_simd();
+
+    return 0;
+}
@@ -1,468 +1,4598 @@
+/* mremap() and MAP_ANONYMOUS, before any header includes features.h */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "garray.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define ELEMENTS_PER_NODE 8
-#define LOG_B2_ELEMENTS_PER_NODE 3
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+
+#define ELEMENTS_PER_NODE GARRAY_WORD_BITS
+#define LOG_B2_ELEMENTS_PER_NODE GARRAY_LOG_B2_WORD_BITS
 
 #define GARRAY_SET_VALUE_SETTED(garray, position)                               \
-    (garray)->values_setted[(position) >> LOG_B2_ELEMENTS_PER_NODE] =           \
-                                                                                ((garray)->values_setted[(position) >> LOG_B2_ELEMENTS_PER_NODE])   \
-                                                                                |  (1u << ((position) % ELEMENTS_PER_NODE))
+    (garray)->values_setted[(position) >> LOG_B2_ELEMENTS_PER_NODE] |=          \
+                                                                                ((garray_word)1 << ((position) % ELEMENTS_PER_NODE))
 
 #define GARRAY_UNSET_VALUE_SETTED(garray, position)                             \
-    (garray)->values_setted[(position) >> LOG_B2_ELEMENTS_PER_NODE] =           \
-                                                                                ((garray)->values_setted[(position) >> LOG_B2_ELEMENTS_PER_NODE]) & \
-                                                                                ~(1u << ((position) % ELEMENTS_PER_NODE))
+    (garray)->values_setted[(position) >> LOG_B2_ELEMENTS_PER_NODE] &=          \
+                                                                                ~((garray_word)1 << ((position) % ELEMENTS_PER_NODE))
 
 #define GARRAY_GET_VALUE_SETTED(garray, position)                        \
     (((garray)->values_setted[(position) >> LOG_B2_ELEMENTS_PER_NODE]) & \
-     (1u << ((position) % ELEMENTS_PER_NODE)))
+     ((garray_word)1 << ((position) % ELEMENTS_PER_NODE)))
+
+/* Number of bytes of values_setted needed to track num_elements elements, always a whole number of words */
+#define VALUES_SETTED_SIZE(num_elements) \
+    ((((size_t)(num_elements) >> LOG_B2_ELEMENTS_PER_NODE) + ((num_elements) % ELEMENTS_PER_NODE != 0)) * \
+     sizeof(garray_word))
 
-static void* TMP_PTR;
+/* Whether position, inside the capacity of the array, is setted. Dense arrays have no holes */
+#define IS_SETTED(garray, position) \
+    ((garray)->dense ? (position) < (garray)->num_elements : \
+     (garray)->paged ? paged_at(garray, position) != NULL : GARRAY_GET_VALUE_SETTED(garray, position) != 0)
+
+/* Same as VALUES_SETTED_SIZE() for the array a, dense arrays have no values_setted */
+#define BITMAP_SIZE(a, num_elements) ((a)->dense ? 0 : VALUES_SETTED_SIZE(num_elements))
+
+/* Keeps the old pointer in a local, arrays may be resized from several threads at the same time */
 #define REALLOC(ptr, new_size, error_message) {\
-        TMP_PTR = ptr; \
-        if((ptr = realloc(ptr, new_size)) == NULL) { \
+        void* new_ptr = realloc(ptr, new_size); \
+        if(new_ptr == NULL) { \
             perror(error_message); \
-            free(TMP_PTR); \
+            free(ptr); \
             abort(); \
         }\
+        ptr = new_ptr; \
     }
 
 typedef int8_t* array_t;
+typedef garray_word* bitmap_t;
 
-struct generic_array {
-    garray_index bytes_allocated; //Total number of bytes allocated for the array
-    garray_index bytes_allocated_values_setted; // Total number of bytes allocated for values_setted
-    garray_index num_elements; //Total number of elements inside the array
-    garray_index next_free; //The index of the next free element
-    garray_index element_size; //The size of each element in bytes
-    array_t values_setted; //An array of bytes that stores whether an element is set or not for each element
-    array_t array;
-};
+/* Capacity of the first block allocated in the heap, in elements */
+#define GARRAY_MIN_CAPACITY 8
 
-struct generic_array_iterator {
-    bool valid_index;
-    garray_index index;
-    struct generic_array* garray;
-};
+/* Memory owned by an array goes through its allocator, scratch buffers of a single call use malloc() */
+#define ARRAY_REALLOC(a, ptr, old_size, new_size, error_message) {\
+        void* new_ptr = (a)->allocator->reallocate((a)->allocator->context, ptr, old_size, new_size); \
+        if(new_ptr == NULL) { \
+            perror(error_message); \
+            abort(); \
+        }\
+        ptr = new_ptr; \
+    }
 
+/*
+ * On Linux blocks of at least GARRAY_MMAP_THRESHOLD bytes are anonymous mappings of their own: growing one
+ * is a mremap() that moves page tables instead of copying the data, the pages past the old size come
+ * zeroed from the kernel and are not touched until they are written, and shrinking one gives its tail
+ * back. With GARRAY_HUGE_PAGES they are advised to be backed by transparent huge pages, which cuts the
+ * TLB misses of random accesses. Smaller blocks go through malloc()
+ */
+#ifndef GARRAY_MMAP_THRESHOLD
+#define GARRAY_MMAP_THRESHOLD ((size_t)1 << 21)
+#endif
 
+#ifndef GARRAY_HUGE_PAGES
+#define GARRAY_HUGE_PAGES 1
+#endif
 
-garray
-___garray_new(garray_index element_size)
-{
-    garray garray = malloc(sizeof(struct generic_array));
+#if defined(__linux__) && defined(MAP_ANONYMOUS)
+#define is_mapped(size) ((size) >= GARRAY_MMAP_THRESHOLD)
 
-    if (garray == NULL) {
-        perror("___garray_new(): malloc\n");
-        abort();
-    }
+/* Mappings are whole huge pages at aligned addresses, so that all of them can be backed by huge pages */
+#define MAP_ALIGN ((size_t)1 << 21)
+#define map_length(size) (((size) + MAP_ALIGN - 1) & ~(MAP_ALIGN - 1))
 
-    garray->bytes_allocated = 0;
-    garray->bytes_allocated_values_setted = 0;
-    garray->num_elements = 0;
-    garray->next_free = 0;
-    garray->element_size = element_size;
-    garray->values_setted = NULL;
-    garray->array = NULL;
+/* Maps length bytes, a multiple of MAP_ALIGN, at an address aligned to MAP_ALIGN */
+static int8_t*
+map_aligned(size_t length)
+{
+    int8_t* ptr = mmap(NULL, length + MAP_ALIGN, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 
-    return garray;
-}
+    if (ptr == MAP_FAILED)
+        return NULL;
 
-garray
-___garray_new_preallocated(garray_index num_elements_preallocated,
-                           garray_index element_size)
-{
-    garray a = ___garray_new(element_size);
+    /* Trims the extra huge page from both ends */
+    const size_t head = (MAP_ALIGN - (uintptr_t)ptr % MAP_ALIGN) % MAP_ALIGN;
 
-    a->bytes_allocated = num_elements_preallocated * element_size;
-    a->bytes_allocated_values_setted = (num_elements_preallocated + 7) >> LOG_B2_ELEMENTS_PER_NODE;
-    a->array = calloc(num_elements_preallocated, element_size);
-    a->values_setted = calloc(a->bytes_allocated_values_setted, 1);
+    if (head > 0)
+        munmap(ptr, head);
 
-    if (a->array == NULL || a->values_setted == NULL) {
-        perror("___garray_new_preallocated(): calloc\n");
-        abort();
-    }
+    munmap(ptr + head + length, MAP_ALIGN - head);
+    ptr += head;
 
-    return a;
+#if GARRAY_HUGE_PAGES && defined(MADV_HUGEPAGE)
+    /* Only advice, it fails harmlessly where transparent huge pages are disabled */
+    madvise(ptr, length, MADV_HUGEPAGE);
+#endif
+
+    return ptr;
 }
 
-static bool
-check_resizing(garray a)
+#define map_block(size) map_aligned(map_length(size))
+
+static void*
+remap_block(void* ptr, size_t old_size, size_t new_size)
 {
-    if (a->next_free * a->element_size < a->bytes_allocated)
-        return false;
+    const size_t old_length = map_length(old_size), new_length = map_length(new_size);
 
-    garray_index previous_allocation = a->bytes_allocated;
+    /*
+     * Shrinking gives the pages of the tail back to the kernel. The bytes kept past new_size are zeroed,
+     * growing takes every byte of a mapping past its size as zero
+     */
+    if (new_length <= old_length) {
+        if (new_size < old_size)
+            memset((int8_t*)ptr + new_size, 0, (old_size < new_length ? old_size : new_length) - new_size);
 
-    a->bytes_allocated = previous_allocation == 0 ? a->element_size : previous_allocation << 1;
+        if (new_length < old_length)
+            munmap((int8_t*)ptr + new_length, old_length - new_length);
 
-    if (a->bytes_allocated <= previous_allocation) {
-        if (previous_allocation < GARRAY_MAX_VALUE)
-            a->bytes_allocated = GARRAY_MAX_VALUE;
-        else {
-            perror("check_resizing(): posible overflow of the garray_index type, try setting it to a bigger data type\n");
-            abort();
-        }
+        return ptr;
     }
 
-    REALLOC(a->array, a->bytes_allocated, "check_resizing(): realloc 1\n");
+#ifdef MREMAP_MAYMOVE
+    /* Grows in place when the address space after the block is free */
+    if (mremap(ptr, old_length, new_length, 0) != MAP_FAILED)
+        return ptr;
 
-    memset(a->array + previous_allocation, 0, a->bytes_allocated - previous_allocation);
+    /* Or moves the pages, without copying them, to the start of an aligned mapping of the new length */
+    int8_t* new_ptr = map_aligned(new_length);
 
-    // The following expression returns the number of bytes needed to store a->values_setted given
-    // the number of bytes needed to store a->array
-#define VALUES_SETTED_SIZE(array_size) (((array_size) / a->element_size + 7) >> LOG_B2_ELEMENTS_PER_NODE)
+    if (new_ptr == NULL)
+        return NULL;
 
-    garray_index previous_allocation_values = VALUES_SETTED_SIZE(previous_allocation);
-    a->bytes_allocated_values_setted = VALUES_SETTED_SIZE(a->bytes_allocated);
-
-    if (a->bytes_allocated_values_setted == previous_allocation_values) //If a->values_setted need not allocation finish
-        return true;
+    if (mremap(ptr, old_length, old_length, MREMAP_MAYMOVE | MREMAP_FIXED, new_ptr) == MAP_FAILED) {
+        munmap(new_ptr, new_length);
+        return NULL;
+    }
 
-    REALLOC(a->values_setted, a->bytes_allocated, "check_resizing(): realloc 2\n");
+    return new_ptr;
+#else
+    int8_t* new_ptr = map_aligned(new_length);
 
-    memset(a->values_setted + previous_allocation_values, 0,
-           VALUES_SETTED_SIZE(a->bytes_allocated - previous_allocation));
+    if (new_ptr != NULL) {
+        memcpy(new_ptr, ptr, old_size);
+        munmap(ptr, old_length);
+    }
 
-    return true;
+    return new_ptr;
+#endif
 }
 
-#define get_element(a, position)\
-    ((a)->array + (position) * (a)->element_size)
+#define unmap_block(ptr, size) munmap(ptr, map_length(size))
+#else
+#define is_mapped(size) false
+#define map_block(size) NULL
+#define remap_block(ptr, old_size, new_size) NULL
+#define unmap_block(ptr, size) ((void)0)
+#endif
 
-static garray_index
-get_next_free(garray a)
+static void*
+malloc_allocate(void* context, size_t size)
 {
-    check_resizing(a);
+    (void)context;
+    return is_mapped(size) ? map_block(size) : malloc(size);
+}
 
-    if (!GARRAY_GET_VALUE_SETTED(a, a->next_free))
-        return a->next_free;
+static void*
+malloc_reallocate(void* context, void* ptr, size_t old_size, size_t new_size)
+{
+    (void)context;
 
-    while (GARRAY_GET_VALUE_SETTED(a, a->next_free)) {
-        a->next_free++;
-        check_resizing(a);
-    }
+    if (!is_mapped(old_size) && !is_mapped(new_size))
+        return realloc(ptr, new_size);
 
-    return a->next_free;
+    if (is_mapped(old_size) && is_mapped(new_size))
+        return remap_block(ptr, old_size, new_size);
+
+    /* Crossing the threshold moves the block between malloc() and a mapping */
+    void* new_ptr = is_mapped(new_size) ? map_block(new_size) : malloc(new_size);
+
+    if (new_ptr == NULL)
+        return NULL;
+
+    if (ptr != NULL)
+        memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+
+    if (is_mapped(old_size))
+        unmap_block(ptr, old_size);
+    else
+        free(ptr);
+
+    return new_ptr;
 }
 
-garray_index
-___garray_add(garray a, const void* data)
+static void
+malloc_deallocate(void* context, void* ptr, size_t size)
 {
-    garray_index pos = get_next_free(a);
+    (void)context;
 
-    memcpy(get_element(a, pos), data, a->element_size);
-    GARRAY_SET_VALUE_SETTED(a, pos);
-    a->num_elements++;
+    if (is_mapped(size))
+        unmap_block(ptr, size);
+    else
+        free(ptr);
+}
 
-    return pos;
+static const struct garray_allocator malloc_allocator = {
+    .allocate = malloc_allocate,
+    .reallocate = malloc_reallocate,
+    .deallocate = malloc_deallocate,
+};
+
+static struct garray_allocator const* default_allocator = &malloc_allocator;
+
+void
+garray_set_default_allocator(struct garray_allocator const* allocator)
+{
+    default_allocator = allocator == NULL ? &malloc_allocator : allocator;
 }
 
-const void*
-___garray_at(garray a, garray_index position)
+/* Every allocation of the arena and the block pool keeps the alignment of malloc() */
+#define ALIGN_UP(size) (((size) + _Alignof(max_align_t) - 1) & ~(_Alignof(max_align_t) - 1))
+
+struct arena_chunk {
+    struct arena_chunk* next;
+    size_t size; //Bytes of data
+    size_t used;
+    max_align_t data[];
+};
+
+struct garray_arena {
+    struct garray_allocator allocator;
+    size_t chunk_size;
+    struct arena_chunk* chunks; //The first one is where allocations are made
+    void* last; //Last allocation, the only one that can grow or be freed in place
+};
+
+static struct arena_chunk*
+arena_chunk_new(size_t size)
 {
-    if (position * a->element_size >= a->bytes_allocated) {
-        perror("garray_at(): position out of bounds\n");
-        abort();
-    }
+    struct arena_chunk* chunk = malloc(sizeof(struct arena_chunk) + size);
 
-    if (!GARRAY_GET_VALUE_SETTED(a, position)) {
-        perror("garray_at(): position not setted\n");
-        abort();
-    }
+    if (chunk == NULL)
+        return NULL;
 
-    return get_element(a, position);
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+
+    return chunk;
 }
 
-const void*
-___garray_at_default(garray a, garray_index position, const void* default_value)
+static void*
+arena_allocate(void* context, size_t size)
 {
-    if (position * a->element_size >= a->bytes_allocated)
-        return default_value;
+    garray_arena arena = context;
+    struct arena_chunk* chunk = arena->chunks;
 
-    if (!GARRAY_GET_VALUE_SETTED(a, position))
-        return default_value;
+    size = ALIGN_UP(size);
 
-    return get_element(a, position);
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        chunk = arena_chunk_new(size > arena->chunk_size ? size : arena->chunk_size);
+
+        if (chunk == NULL)
+            return NULL;
+
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+    }
+
+    arena->last = (int8_t*)chunk->data + chunk->used;
+    chunk->used += size;
+
+    return arena->last;
 }
 
-void
-___garray_set(garray a, garray_index position, const void* restrict data)
+static void*
+arena_reallocate(void* context, void* ptr, size_t old_size, size_t new_size)
 {
-    if (position * a->element_size >= a->bytes_allocated) {
-        garray_index old_next_free = a->next_free;
-        a->next_free = position;
+    garray_arena arena = context;
 
-        while (check_resizing(a));
+    if (ptr == NULL)
+        return arena_allocate(context, new_size);
 
-        a->next_free = old_next_free;
+    if (ptr == arena->last) {
+        struct arena_chunk* chunk = arena->chunks;
+        size_t offset = (size_t)((int8_t*)ptr - (int8_t*)chunk->data);
 
-        a->num_elements++;
+        if (chunk->size - offset >= ALIGN_UP(new_size)) {
+            chunk->used = offset + ALIGN_UP(new_size);
+            return ptr;
+        }
     }
 
-    memcpy(get_element(a, position), data, a->element_size);
-    GARRAY_SET_VALUE_SETTED(a, position);
+    void* new_ptr = arena_allocate(context, new_size);
+
+    if (new_ptr != NULL)
+        memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+
+    return new_ptr;
 }
 
-void
-___garray_remove(garray a, garray_index position)
+static void
+arena_deallocate(void* context, void* ptr, size_t size)
 {
-    GARRAY_UNSET_VALUE_SETTED(a, position);
-    a->num_elements--;
+    garray_arena arena = context;
 
-    if (position < a->next_free)
-        a->next_free = position;
+    (void)size;
+
+    if (ptr != arena->last)
+        return;
+
+    arena->chunks->used = (size_t)((int8_t*)ptr - (int8_t*)arena->chunks->data);
+    arena->last = NULL;
 }
 
-garray_index
-___garray_size(garray a)
+garray_arena
+garray_arena_new(size_t chunk_size)
 {
-    return a->num_elements;
+    garray_arena arena = malloc(sizeof(struct garray_arena));
+
+    if (arena == NULL) {
+        perror("garray_arena_new(): malloc\n");
+        abort();
+    }
+
+    arena->allocator = (struct garray_allocator) {
+        .allocate = arena_allocate,
+        .reallocate = arena_reallocate,
+        .deallocate = arena_deallocate,
+        .context = arena,
+    };
+    arena->chunk_size = ALIGN_UP(chunk_size);
+    arena->chunks = NULL;
+    arena->last = NULL;
+
+    return arena;
 }
 
-garray
-___garray_clone(garray a)
+struct garray_allocator const*
+garray_arena_allocator(garray_arena arena)
 {
-    garray new_a = ___garray_new(a->element_size);
+    return &arena->allocator;
+}
 
-    new_a->bytes_allocated = a->bytes_allocated;
-    new_a->bytes_allocated_values_setted = a->bytes_allocated_values_setted;
-    new_a->num_elements = a->num_elements;
-    new_a->next_free = a->next_free;
+void
+garray_arena_reset(garray_arena arena)
+{
+    if (arena->chunks == NULL)
+        return;
 
-    new_a->array = malloc(a->bytes_allocated);
-    new_a->values_setted = malloc(a->bytes_allocated_values_setted);
+    /* Keep the newest chunk to reuse it */
+    struct arena_chunk* chunk = arena->chunks->next;
 
-    memcpy(new_a->array, a->array, a->bytes_allocated);
-    memcpy(new_a->values_setted, a->values_setted, a->bytes_allocated_values_setted);
+    while (chunk != NULL) {
+        struct arena_chunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
 
-    return new_a;
+    arena->chunks->next = NULL;
+    arena->chunks->used = 0;
+    arena->last = NULL;
 }
 
 void
-___garray_collapse(garray a)
+garray_arena_free(garray_arena arena)
 {
-    garray_index tail = (a->bytes_allocated / a->element_size) - 1;
-
-    for (garray_index head = 0; head < tail; head++) {
-        if (GARRAY_GET_VALUE_SETTED(a, head))
-            continue;
+    garray_arena_reset(arena);
+    free(arena->chunks);
+    free(arena);
+}
 
-        while (!GARRAY_GET_VALUE_SETTED(a, tail)) {
-            if (head == --tail)
-                goto collapse_break_loop;
-        }
+struct block_chunk {
+    struct block_chunk* next;
+    max_align_t data[];
+};
 
-        memcpy(get_element(a, head), get_element(a, tail), a->element_size);
+struct garray_block_pool {
+    struct garray_allocator allocator;
+    size_t block_size;
+    size_t blocks_per_chunk;
+    struct block_chunk* chunks;
+    void* free_blocks; //Each free block starts with a pointer to the next one
+};
 
-        GARRAY_UNSET_VALUE_SETTED(a, tail);
-        GARRAY_SET_VALUE_SETTED(a, head);
-    }
+static void*
+block_pool_allocate(void* context, size_t size)
+{
+    garray_block_pool pool = context;
 
-collapse_break_loop :;
+    if (size > pool->block_size)
+        return malloc(size);
 
-    /* If the last element is unset, do not count it */
-    a->next_free = GARRAY_GET_VALUE_SETTED(a, tail) ? tail + 1 : tail;
+    if (pool->free_blocks == NULL) {
+        struct block_chunk* chunk = malloc(sizeof(struct block_chunk) +
+                                           pool->block_size * pool->blocks_per_chunk);
 
-    a->bytes_allocated = (a->next_free * a->element_size) + a->element_size;
+        if (chunk == NULL)
+            return NULL;
 
-    if (a->bytes_allocated == 0) {
-        free(a->array);
-        a->array = NULL;
-    } else
-        REALLOC(a->array, a->bytes_allocated, "___garray_collapse(): realloc\n");
-}
+        chunk->next = pool->chunks;
+        pool->chunks = chunk;
 
-garray
-___garray_sort(garray a, int criteria(void const*, void const*))
-{
-    a = ___garray_clone(a);
+        for (size_t i = pool->blocks_per_chunk; i-- > 0;) {
+            void* block = (int8_t*)chunk->data + i * pool->block_size;
 
-    ___garray_collapse(a);
+            *(void**)block = pool->free_blocks;
+            pool->free_blocks = block;
+        }
+    }
 
-    qsort(a->array, a->num_elements, a->element_size, criteria);
+    void* block = pool->free_blocks;
+    pool->free_blocks = *(void**)block;
 
-    return a;
+    return block;
 }
 
-void
-___garray_free(garray a)
+static void
+block_pool_deallocate(void* context, void* ptr, size_t size)
 {
+    garray_block_pool pool = context;
 
-    if (a->array != NULL) {
-        free(a->array);
-        free(a->values_setted);
+    if (size > pool->block_size) {
+        free(ptr);
+        return;
     }
 
-    free(a);
+    *(void**)ptr = pool->free_blocks;
+    pool->free_blocks = ptr;
 }
 
-garray_iter
-___garray_iter_new(garray a)
+static void*
+block_pool_reallocate(void* context, void* ptr, size_t old_size, size_t new_size)
 {
+    garray_block_pool pool = context;
 
-    garray_iter new_iter = malloc(sizeof(struct generic_array_iterator));
+    if (ptr == NULL)
+        return block_pool_allocate(context, new_size);
 
-    if (new_iter == NULL) {
-        perror("___garray_iter_new(): malloc\n");
-        abort();
-    }
+    if (old_size <= pool->block_size && new_size <= pool->block_size)
+        return ptr;
+
+    if (old_size > pool->block_size && new_size > pool->block_size)
+        return realloc(ptr, new_size);
+
+    void* new_ptr = block_pool_allocate(context, new_size);
+
+    if (new_ptr == NULL)
+        return NULL;
 
-    new_iter->garray = a;
-    new_iter->index = 0;
-    new_iter->valid_index = a->array == NULL ? false : GARRAY_GET_VALUE_SETTED(a,
-                                                                               0);
+    memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+    block_pool_deallocate(context, ptr, old_size);
 
-    return new_iter;
+    return new_ptr;
 }
 
-bool
-___garray_iter_condition(garray_iter iterator)
+garray_block_pool
+garray_block_pool_new(size_t block_size, size_t blocks_per_chunk)
 {
-    return iterator->valid_index;
-}
+    garray_block_pool pool = malloc(sizeof(struct garray_block_pool));
 
-#define fast_condition(iter) iter->valid_index
+    if (pool == NULL) {
+        perror("garray_block_pool_new(): malloc\n");
+        abort();
+    }
 
-void
-___garray_iter_free(garray_iter iterator)
-{
-    free(iterator);
+    pool->allocator = (struct garray_allocator) {
+        .allocate = block_pool_allocate,
+        .reallocate = block_pool_reallocate,
+        .deallocate = block_pool_deallocate,
+        .context = pool,
+    };
+    pool->block_size = ALIGN_UP(block_size < sizeof(void*) ? sizeof(void*) : block_size);
+    pool->blocks_per_chunk = blocks_per_chunk == 0 ? 1 : blocks_per_chunk;
+    pool->chunks = NULL;
+    pool->free_blocks = NULL;
+
+    return pool;
 }
 
-bool
-___garray_iter_condition_free(garray_iter iterator)
+struct garray_allocator const*
+garray_block_pool_allocator(garray_block_pool pool)
 {
-    if (fast_condition(iterator))
-        return true;
-
-    ___garray_iter_free(iterator);
-    return false;
+    return &pool->allocator;
 }
 
 void
-___garray_iter_next(garray_iter iterator)
+garray_block_pool_free(garray_block_pool pool)
 {
-    const garray_index max_index = iterator->garray->bytes_allocated /
-                                   iterator->garray->element_size;
+    struct block_chunk* chunk = pool->chunks;
 
-    while (++iterator->index < max_index) {
-        if (GARRAY_GET_VALUE_SETTED(iterator->garray, iterator->index)) {
-            iterator->valid_index = true;
-            return;
-        }
+    while (chunk != NULL) {
+        struct block_chunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
     }
 
-    iterator->valid_index = false;
+    free(pool);
 }
 
-void
-___garray_iter_previous(garray_iter iterator)
+static void*
+allocate(garray a, size_t size, const char* error_message)
 {
+    void* ptr = a->allocator->allocate(a->allocator->context, size);
 
-    /* index has an offset of +1,                   */
-    /* so that when it reaches 0 that would be -1,  */
-    /* because whe are using unsigned types         */
-    while (iterator->index-- > 0) {
-        if (GARRAY_GET_VALUE_SETTED(iterator->garray, iterator->index)) {
-            iterator->valid_index = true;
-            return;
-        }
+    if (ptr == NULL) {
+        perror(error_message);
+        abort();
     }
 
-    iterator->valid_index = false;
+    return ptr;
 }
 
-void const*
-___garray_iter_get(garray_iter iterator)
+static void
+deallocate(garray a, void* ptr, size_t size)
 {
-    return get_element(iterator->garray, iterator->index);
+    if (ptr != NULL)
+        a->allocator->deallocate(a->allocator->context, ptr, size);
 }
-#define fast_iter_get(iter) get_element(iter->garray, iter->index)
 
-void
-___garray_iter_set(garray_iter iterator, void const* data)
+/* Number of words of the bitmap at level, level 0 is values_setted and level n is full_summary[n - 1] */
+static garray_index
+summary_words_of(size_t bytes_values_setted, int level)
 {
-    ___garray_set(iterator->garray, iterator->index, data);
+    garray_index words = bytes_values_setted / sizeof(garray_word);
+
+    while (level-- > 0)
+        words = (words + ELEMENTS_PER_NODE - 1) >> LOG_B2_ELEMENTS_PER_NODE;
+
+    return words;
 }
 
-garray_index
-___garray_iter_get_index(garray_iter iterator)
+#define summary_words(a, level) summary_words_of((a)->bytes_allocated_values_setted, level)
+
+static bitmap_t
+summary_level(garray a, int level)
 {
-    return iterator->index;
+    return level == 0 ? a->values_setted : a->full_summary[level - 1];
 }
 
-bool
-___garray_iter_set_index(garray_iter iterator, garray_index index)
+/*
+ * The data, values_setted and every level of full_summary share a single block, in that order.
+ * values_setted starts at the first word boundary after the data
+ */
+static size_t
+bitmap_offset(size_t data_size)
 {
-    if (index >= iterator->garray->bytes_allocated / iterator->garray->element_size)
-        return false;
+    return (data_size + sizeof(garray_word) - 1) & ~(sizeof(garray_word) - 1);
+}
 
-    iterator->valid_index = GARRAY_GET_VALUE_SETTED(iterator->garray,
-                                                    iterator->index);
+#define get_element(a, position) ((int8_t*)___garray_slot(a, position, (a)->element_size))
 
-    iterator->index = index;
-    return true;
+#define get_capacity(a) ((a)->capacity)
+
+/* Bytes of data of capacity elements, max_capacity() keeps it from overflowing */
+#define data_size(a, capacity) ((size_t)(capacity) * (a)->element_size)
+
+/* Bytes of data in the block of the array, the data of a segmented array is in its segments */
+#define block_data(a) ((a)->segmented ? 0 : data_size(a, (a)->capacity))
+
+static size_t
+block_size(size_t data_size, size_t bytes_values_setted)
+{
+    size_t size = bitmap_offset(data_size) + bytes_values_setted;
+
+    for (int level = 1; level <= GARRAY_SUMMARY_LEVELS; level++)
+        size += summary_words_of(bytes_values_setted, level) * sizeof(garray_word);
+
+    return size;
 }
 
-bool
-___garray_contains(garray a, const void* value,
-                   bool comparator(void const* left, void const* right))
+/* Points values_setted and full_summary to their place in the block of the array */
+static void
+locate_bitmaps(garray a)
 {
-    garray_iter iter;
+    /* Readers of a concurrent array may be loading it */
+    __atomic_store_n(&a->values_setted, a->dense ? NULL : (bitmap_t)(a->array + bitmap_offset(block_data(a))),
+                     __ATOMIC_RELEASE);
 
-    for (iter = ___garray_iter_new(a); ___garray_iter_condition_free(iter);
-         ___garray_iter_next(iter)) {
-        if (comparator(&value, fast_iter_get(iter))) {
-            ___garray_iter_free(iter);
-            return true;
-        }
+    for (int level = 1; level <= GARRAY_SUMMARY_LEVELS; level++)
+        a->full_summary[level - 1] = summary_words(a, level) == 0 ? NULL :
+                                     summary_level(a, level - 1) + summary_words(a, level - 1);
+}
+
+/* Places every level of full_summary after values_setted and recomputes it */
+static void
+resize_summary(garray a)
+{
+    locate_bitmaps(a);
+
+    for (int level = 1; level <= GARRAY_SUMMARY_LEVELS; level++) {
+        bitmap_t below = summary_level(a, level - 1);
+        garray_index words_below = summary_words(a, level - 1);
+        garray_index words = summary_words(a, level);
+
+        if (words == 0)
+            continue;
+
+        memset(a->full_summary[level - 1], 0, words * sizeof(garray_word));
+
+        for (garray_index word = 0; word < words_below; word++)
+            if (below[word] == GARRAY_WORD_FULL)
+                a->full_summary[level - 1][word >> LOG_B2_ELEMENTS_PER_NODE] |=
+                    (garray_word)1 << (word % ELEMENTS_PER_NODE);
     }
+}
 
-    return false;
+/* Whether the block of the array is the inline one of the header */
+#define is_inline(a) ((a)->array == (array_t)(a)->inline_block)
+
+/*
+ * Format of the files of garray_save(): a FILE_HEADER_SIZE bytes header and then the block of a flat or
+ * dense array as it is in memory, the data, values_setted and the summary. ___garray_open_mmap() maps the
+ * file whole and points the block of the array right after the header, so opening it reads nothing.
+ * Incompatible changes to the format or to the layout of the block must bump FILE_VERSION.
+ */
+#define FILE_MAGIC "GARRAY"
+#define FILE_VERSION 1
+#define FILE_BYTE_ORDER 0x0102030405060708u
+#define FILE_HEADER_SIZE 64
+
+struct file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t dense;
+    uint64_t byte_order; //Tells files written on a host of the other endianness
+    uint64_t element_size;
+    uint64_t capacity;
+    uint64_t num_elements;
+    uint64_t next_free;
+    uint64_t bytes_values_setted;
+};
+
+_Static_assert(sizeof(struct file_header) <= FILE_HEADER_SIZE, "the file header does not fit");
+
+/* The file an opened array is mapped from */
+struct garray_file {
+    enum garray_map_mode mode;
+    int fd; //Only kept open for GARRAY_MAP_SHARED, to resize the file with the array
+    int8_t* mapping; //The header and then the block of the array
+    size_t length;
+};
+
+#define is_shared_file(a) ((a)->file != NULL && (a)->file->mode == GARRAY_MAP_SHARED)
+
+static struct file_header
+file_header(garray a)
+{
+    struct file_header header = {
+        .magic = FILE_MAGIC,
+        .version = FILE_VERSION,
+        .dense = a->dense,
+        .byte_order = FILE_BYTE_ORDER,
+        .element_size = a->element_size,
+        .capacity = a->array == NULL ? 0 : a->capacity,
+        .num_elements = a->num_elements,
+        .next_free = a->next_free,
+        .bytes_values_setted = a->bytes_allocated_values_setted,
+    };
+
+    return header;
 }
 
-garray
-___garray_query(
-    garray a, void* data,
-    bool condition(void const* value, void* data))
+#ifdef __linux__
+/* Unmaps the file of the array, writing its header first if the changes go to the file */
+static void
+close_file(garray a)
 {
-    garray new_a = ___garray_new(a->element_size);
-    void const* current = NULL;
+    struct garray_file* file = a->file;
 
-    for (garray_iter it = ___garray_iter_new(a); ___garray_iter_condition_free(it);
-         ___garray_iter_next(it)) {
-        current = ___garray_iter_get(it);
+    if (file->mode == GARRAY_MAP_SHARED) {
+        struct file_header header = file_header(a);
 
-        if (condition(current, data))
-            ___garray_add(new_a, current);
+        memcpy(file->mapping, &header, sizeof(header));
+        close(file->fd);
     }
 
-    return new_a;
+    munmap(file->mapping, file->length);
+    deallocate(a, file, sizeof(struct garray_file));
+    a->file = NULL;
 }
 
-void const*
-___garray_get(garray a, void* data, bool condition(void const* value,
-                                                   void* data))
+/* Resizes the shared file of the array, and its mapping, to hold a block of size bytes */
+static void
+resize_file(garray a, size_t size, const char* error_message)
 {
-    void const* current = NULL;
-    garray_iter it;
+    struct garray_file* file = a->file;
+    const size_t length = FILE_HEADER_SIZE + size;
 
-    for (it = ___garray_iter_new(a); ___garray_iter_condition(it);
-         ___garray_iter_next(it)) {
-        current = ___garray_iter_get(it);
-
-        if (condition(current, data)) {
-            ___garray_iter_free(it);
-            return current;
-        }
+    if (ftruncate(file->fd, (off_t)length) != 0) {
+        perror(error_message);
+        abort();
     }
 
-    ___garray_iter_free(it);
+#ifdef MREMAP_MAYMOVE
+    int8_t* mapping = mremap(file->mapping, file->length, length, MREMAP_MAYMOVE);
+#else
+    /* The pages of a shared mapping are the ones of the file, mapping it again loses nothing */
+    munmap(file->mapping, file->length);
+    int8_t* mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+#endif
+
+    if (mapping == MAP_FAILED) {
+        perror(error_message);
+        abort();
+    }
+
+    file->mapping = mapping;
+    file->length = length;
+    a->array = mapping + FILE_HEADER_SIZE;
+}
+#else
+#define close_file(a) ((void)0)
+#define resize_file(a, size, error_message) abort()
+#endif
+
+/*
+ * State of a concurrent array, a segmented array whose add, set, remove, at and GARRAY_FOREACH can run
+ * from several threads at the same time. Writers claim a position in pending, write the element there and
+ * only then publish it in values_setted, so readers, that take no lock, never find a bit setted before
+ * its element. Growing waits for the writers in flight, and keeps the replaced blocks of bitmaps until the
+ * array is freed because readers may still be walking them. The elements themselves never move.
+ */
+#define WRITERS_GROWING (1u << 31)
+
+struct retired_block {
+    struct retired_block* next;
+    void* block;
+    size_t size;
+};
+
+struct garray_concurrent {
+    atomic_uint writers; //Writers in flight, and WRITERS_GROWING while the array grows
+    pthread_mutex_t growing; //Held by the thread growing the array
+    garray_word* pending; //Positions claimed by a writer that has not published them yet, all zero at rest
+    garray_index pending_capacity; //Positions pending has room for
+    struct retired_block* retired; //Blocks replaced while readers could be using them
+};
+
+static struct garray_concurrent*
+concurrent_new(garray a)
+{
+    struct garray_concurrent* concurrent = allocate(a, sizeof(struct garray_concurrent), "___garray_new(): malloc\n");
+
+    atomic_init(&concurrent->writers, 0);
+    pthread_mutex_init(&concurrent->growing, NULL);
+    concurrent->pending = NULL;
+    concurrent->pending_capacity = 0;
+    concurrent->retired = NULL;
+
+    return concurrent;
+}
+
+static void
+concurrent_free(garray a)
+{
+    struct garray_concurrent* concurrent = a->concurrent;
+
+    while (concurrent->retired != NULL) {
+        struct retired_block* retired = concurrent->retired;
+
+        concurrent->retired = retired->next;
+        deallocate(a, retired->block, retired->size);
+        deallocate(a, retired, sizeof(struct retired_block));
+    }
+
+    if (concurrent->pending != NULL)
+        deallocate(a, concurrent->pending, VALUES_SETTED_SIZE(concurrent->pending_capacity));
+
+    pthread_mutex_destroy(&concurrent->growing);
+    deallocate(a, concurrent, sizeof(struct garray_concurrent));
+    a->concurrent = NULL;
+}
+
+/* Keeps the block of size bytes of a concurrent array until it is freed */
+static void
+retire_block(garray a, size_t size)
+{
+    struct retired_block* retired = allocate(a, sizeof(struct retired_block), "grow(): malloc\n");
+
+    retired->next = a->concurrent->retired;
+    retired->block = a->array;
+    retired->size = size;
+    a->concurrent->retired = retired;
+}
+
+/* Frees the block of the array of size bytes, that is not freed if it is the inline one */
+static void
+release_block(garray a, size_t size)
+{
+    if (a->file != NULL)
+        close_file(a);
+    else if (!is_inline(a))
+        deallocate(a, a->array, size);
+}
+
+/*
+ * Reallocates the block of the array from previous_size to size bytes. A block in the header or in a
+ * file that is not shared is copied to a new allocation, from then on it is reallocated as any other.
+ * The block of a concurrent array is always copied, and the old one retired
+ */
+static void
+resize_block(garray a, size_t previous_size, size_t size, const char* error_message)
+{
+    if (is_shared_file(a)) {
+        resize_file(a, size, error_message);
+    } else if (a->concurrent != NULL) {
+        array_t array = allocate(a, size, error_message);
+
+        if (a->array != NULL) {
+            memcpy(array, a->array, previous_size < size ? previous_size : size);
+            retire_block(a, previous_size);
+        }
+
+        __atomic_store_n(&a->array, array, __ATOMIC_RELEASE);
+    } else if (is_inline(a) || a->file != NULL) {
+        array_t array = allocate(a, size, error_message);
+
+        memcpy(array, a->array, previous_size < size ? previous_size : size);
+        release_block(a, previous_size);
+        a->array = array;
+    } else
+        ARRAY_REALLOC(a, a->array, previous_size, size, error_message);
+}
+
+/* Most elements whose block fits in the header, 0 if not even one does */
+static garray_index
+inline_capacity(garray a)
+{
+    garray_index capacity = a->paged || a->segmented ? 0 : GARRAY_INLINE_BYTES / a->element_size;
+
+    while (capacity > 0 &&
+           block_size(data_size(a, capacity), BITMAP_SIZE(a, capacity)) > GARRAY_INLINE_BYTES)
+        capacity--;
+
+    return capacity;
+}
+
+/* Where an array keeps its elements, see ___garray_new(), ___garray_new_dense(), ... */
+enum storage {
+    STORAGE_FLAT,
+    STORAGE_DENSE,
+    STORAGE_PAGED,
+    STORAGE_SEGMENTED,
+    STORAGE_CONCURRENT,
+};
+
+static garray
+new_array(garray_index element_size, struct garray_allocator const* allocator, enum storage storage)
+{
+    if (allocator == NULL)
+        allocator = default_allocator;
+
+    garray garray = allocator->allocate(allocator->context, sizeof(struct generic_array));
+
+    if (garray == NULL) {
+        perror("___garray_new(): malloc\n");
+        abort();
+    }
+
+    garray->capacity = 0;
+    garray->bytes_allocated_values_setted = 0;
+    garray->num_elements = 0;
+    garray->next_free = 0;
+    garray->element_size = element_size;
+    garray->values_setted = NULL;
+    garray->array = NULL;
+    garray->allocator = allocator;
+    garray->dense = storage == STORAGE_DENSE;
+    garray->paged = storage == STORAGE_PAGED;
+    garray->page_tables = NULL;
+    garray->num_page_tables = 0;
+    garray->segmented = storage == STORAGE_SEGMENTED || storage == STORAGE_CONCURRENT;
+    garray->segments = NULL;
+    garray->file = NULL;
+    garray->concurrent = storage == STORAGE_CONCURRENT ? concurrent_new(garray) : NULL;
+    garray->compaction = NULL;
+
+    for (int level = 0; level < GARRAY_SUMMARY_LEVELS; level++)
+        garray->full_summary[level] = NULL;
+
+    garray_index capacity = inline_capacity(garray);
+
+    /* Small arrays live in the header and need no allocation until they outgrow it */
+    if (capacity > 0) {
+        garray->array = (array_t)garray->inline_block;
+        garray->capacity = capacity;
+        garray->bytes_allocated_values_setted = BITMAP_SIZE(garray, capacity);
+        memset(garray->inline_block, 0, sizeof(garray->inline_block));
+        resize_summary(garray);
+    }
+
+    return garray;
+}
+
+garray
+___garray_new_with_allocator(garray_index element_size, struct garray_allocator const* allocator)
+{
+    return new_array(element_size, allocator, STORAGE_FLAT);
+}
+
+garray
+___garray_new(garray_index element_size)
+{
+    return new_array(element_size, NULL, STORAGE_FLAT);
+}
+
+garray
+___garray_new_dense(garray_index element_size, struct garray_allocator const* allocator)
+{
+    return new_array(element_size, allocator, STORAGE_DENSE);
+}
+
+garray
+___garray_new_paged(garray_index element_size, struct garray_allocator const* allocator)
+{
+    return new_array(element_size, allocator, STORAGE_PAGED);
+}
+
+garray
+___garray_new_segmented(garray_index element_size, struct garray_allocator const* allocator)
+{
+    return new_array(element_size, allocator, STORAGE_SEGMENTED);
+}
+
+garray
+___garray_new_concurrent(garray_index element_size, struct garray_allocator const* allocator)
+{
+    return new_array(element_size, allocator, STORAGE_CONCURRENT);
+}
+
+#define storage_of(a)                                                                                     \
+    ((a)->dense ? STORAGE_DENSE : (a)->paged ? STORAGE_PAGED : (a)->concurrent != NULL ? STORAGE_CONCURRENT : \
+     (a)->segmented ? STORAGE_SEGMENTED : STORAGE_FLAT)
+
+/* An empty array with the same element size, allocator and mode as a */
+#define new_like(a) new_array((a)->element_size, (a)->allocator, storage_of(a))
+
+/* Sets the bit of position in values_setted, returns whether it was already setted */
+static bool
+mark_setted(garray a, garray_index position)
+{
+    if (GARRAY_GET_VALUE_SETTED(a, position))
+        return true;
+
+    GARRAY_SET_VALUE_SETTED(a, position);
+
+    for (int level = 0; level < GARRAY_SUMMARY_LEVELS; level++) {
+        garray_index word = position >> LOG_B2_ELEMENTS_PER_NODE;
+
+        if (summary_level(a, level)[word] != GARRAY_WORD_FULL)
+            break;
+
+        position = word;
+        a->full_summary[level][position >> LOG_B2_ELEMENTS_PER_NODE] |=
+            (garray_word)1 << (position % ELEMENTS_PER_NODE);
+    }
+
+    return false;
+}
+
+/* Unsets the bit of position in values_setted, returns whether it was setted */
+static bool
+mark_unsetted(garray a, garray_index position)
+{
+    if (!GARRAY_GET_VALUE_SETTED(a, position))
+        return false;
+
+    for (int level = 0; level <= GARRAY_SUMMARY_LEVELS; level++) {
+        bitmap_t bitmap = summary_level(a, level);
+        garray_index word = position >> LOG_B2_ELEMENTS_PER_NODE;
+        bool was_full = bitmap[word] == GARRAY_WORD_FULL;
+
+        bitmap[word] &= ~((garray_word)1 << (position % ELEMENTS_PER_NODE));
+
+        if (!was_full)
+            break;
+
+        position = word;
+    }
+
+    return true;
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define POPCOUNT(word) ((garray_index)__builtin_popcountll(word))
+#else
+static garray_index
+POPCOUNT(garray_word word)
+{
+    garray_index n = 0;
+
+    for (; word != 0; word &= word - 1)
+        n++;
+
+    return n;
+}
+#endif
+
+/* Recomputes the bits of every level of full_summary that cover the words [first_word, last_word] of values_setted */
+static void
+update_summary(garray a, garray_index first_word, garray_index last_word)
+{
+    for (int level = 1; level <= GARRAY_SUMMARY_LEVELS; level++) {
+        bitmap_t below = summary_level(a, level - 1);
+        bitmap_t bitmap = a->full_summary[level - 1];
+
+        for (garray_index word = first_word; word <= last_word; word++) {
+            garray_word bit = (garray_word)1 << (word % ELEMENTS_PER_NODE);
+
+            if (below[word] == GARRAY_WORD_FULL)
+                bitmap[word >> LOG_B2_ELEMENTS_PER_NODE] |= bit;
+            else
+                bitmap[word >> LOG_B2_ELEMENTS_PER_NODE] &= ~bit;
+        }
+
+        first_word >>= LOG_B2_ELEMENTS_PER_NODE;
+        last_word >>= LOG_B2_ELEMENTS_PER_NODE;
+    }
+}
+
+/* Sets or unsets the bits [from, end) of bitmap a word at a time, returns how many bits changed */
+static garray_index
+mark_bits(bitmap_t bitmap, garray_index from, garray_index end, bool setted)
+{
+    if (from >= end)
+        return 0;
+
+    const garray_index first_word = from >> LOG_B2_ELEMENTS_PER_NODE;
+    const garray_index last_word = (end - 1) >> LOG_B2_ELEMENTS_PER_NODE;
+    garray_index changed = 0;
+
+    for (garray_index word = first_word; word <= last_word; word++) {
+        garray_word mask = GARRAY_WORD_FULL;
+
+        if (word == first_word)
+            mask &= GARRAY_WORD_FULL << (from % ELEMENTS_PER_NODE);
+
+        if (word == last_word)
+            mask &= GARRAY_WORD_FULL >> (ELEMENTS_PER_NODE - 1 - (end - 1) % ELEMENTS_PER_NODE);
+
+        if (setted) {
+            changed += POPCOUNT(mask & ~bitmap[word]);
+            bitmap[word] |= mask;
+        } else {
+            changed += POPCOUNT(mask & bitmap[word]);
+            bitmap[word] &= ~mask;
+        }
+    }
+
+    return changed;
+}
+
+/* Same as mark_bits() on values_setted, keeping full_summary up to date */
+static garray_index
+mark_range(garray a, garray_index from, garray_index end, bool setted)
+{
+    if (from >= end)
+        return 0;
+
+    garray_index changed = mark_bits(a->values_setted, from, end, setted);
+
+    update_summary(a, from >> LOG_B2_ELEMENTS_PER_NODE, (end - 1) >> LOG_B2_ELEMENTS_PER_NODE);
+
+    return changed;
+}
+
+/*
+ * Returns the first unsetted bit of the bitmap at level in [from, end), end if there is none.
+ * Whole full words are skipped by looking for the next not full word one level up
+ */
+static garray_index
+summary_next_unsetted(garray a, int level, garray_index from, garray_index end)
+{
+    if (from >= end)
+        return end;
+
+    bitmap_t bitmap = summary_level(a, level);
+    const garray_index words = summary_words(a, level);
+    garray_index word = from >> LOG_B2_ELEMENTS_PER_NODE;
+    garray_word bits = ~bitmap[word] & (GARRAY_WORD_FULL << (from % ELEMENTS_PER_NODE));
+
+    if (bits == 0) {
+        if (level == GARRAY_SUMMARY_LEVELS) {
+            do {
+                if (++word >= words)
+                    return end;
+            } while ((bits = ~bitmap[word]) == 0);
+        } else {
+            word = summary_next_unsetted(a, level + 1, word + 1, words);
+
+            if (word >= words)
+                return end;
+
+            bits = ~bitmap[word];
+        }
+    }
+
+    from = (word << LOG_B2_ELEMENTS_PER_NODE) + GARRAY_CTZ(bits);
+
+    return from < end ? from : end;
+}
+
+/*
+ * Segment 0 of a segmented array holds FIRST_SEGMENT elements and segment n > 0 the elements
+ * [FIRST_SEGMENT << (n - 1), FIRST_SEGMENT << n), so the capacity is always FIRST_SEGMENT << (n - 1)
+ * with n + 1 segments. segments has room for every segment a garray_index can address.
+ */
+#define FIRST_SEGMENT ((garray_index)1 << GARRAY_LOG_B2_FIRST_SEGMENT)
+#define MAX_SEGMENTS (sizeof(garray_index) * CHAR_BIT - GARRAY_LOG_B2_FIRST_SEGMENT + 1)
+
+static garray_index
+segment_of(garray_index position)
+{
+    if (position < FIRST_SEGMENT)
+        return 0;
+
+    return GARRAY_WORD_BITS - GARRAY_CLZ(position >> GARRAY_LOG_B2_FIRST_SEGMENT);
+}
+
+#define segment_start(segment) ((segment) == 0 ? 0 : FIRST_SEGMENT << ((segment) - 1))
+#define segment_length(segment) ((segment) == 0 ? FIRST_SEGMENT : FIRST_SEGMENT << ((segment) - 1))
+
+/* Number of segments of a capacity of elements */
+#define num_segments(capacity) ((capacity) == 0 ? 0 : segment_of((capacity) - 1) + 1)
+
+/* Allocates the segments that take the capacity from previous_capacity to capacity, nothing is moved */
+static void
+add_segments(garray a, garray_index previous_capacity, garray_index capacity)
+{
+    if (a->segments == NULL) {
+        a->segments = allocate(a, MAX_SEGMENTS * sizeof(int8_t*), "grow(): malloc\n");
+        memset(a->segments, 0, MAX_SEGMENTS * sizeof(int8_t*));
+    }
+
+    for (garray_index segment = num_segments(previous_capacity); segment < num_segments(capacity); segment++)
+        a->segments[segment] = allocate(a, (size_t)segment_length(segment) * a->element_size, "grow(): malloc\n");
+}
+
+/* Frees the segments past a capacity of capacity elements */
+static void
+remove_segments(garray a, garray_index previous_capacity, garray_index capacity)
+{
+    for (garray_index segment = num_segments(capacity); segment < num_segments(previous_capacity); segment++) {
+        deallocate(a, a->segments[segment], (size_t)segment_length(segment) * a->element_size);
+        a->segments[segment] = NULL;
+    }
+}
+
+/* Number of elements from position that are contiguous in memory */
+static garray_index
+contiguous_run(garray a, garray_index position)
+{
+    if (a->segmented)
+        return segment_start(segment_of(position)) + segment_length(segment_of(position)) - position;
+
+    return GARRAY_MAX_VALUE - position;
+}
+
+/* Copies n elements from data to the positions [position, position + n) of an array that is not paged */
+static void
+copy_to(garray a, garray_index position, const int8_t* data, garray_index n)
+{
+    while (n > 0) {
+        garray_index run = contiguous_run(a, position);
+
+        if (run > n)
+            run = n;
+
+        memcpy(get_element(a, position), data, (size_t)run * a->element_size);
+        position += run;
+        data += (size_t)run * a->element_size;
+        n -= run;
+    }
+}
+
+/*
+ * Most elements an array can hold: their positions have to fit in a garray_index and their block, with a
+ * bit of values_setted and its summary for each one, in a size_t
+ */
+static garray_index
+max_capacity(garray a)
+{
+    const size_t max = SIZE_MAX / (a->element_size + 1);
+
+    return max < GARRAY_MAX_VALUE ? (garray_index)max : GARRAY_MAX_VALUE;
+}
+
+/* Whether a block of size bytes of the array is a mapping, whose new bytes come zeroed from the kernel */
+#define zeroed_block(a, size) ((a)->allocator == &malloc_allocator && is_mapped(size))
+
+/* Zeroes the bytes [from, to) of block that are before fresh, the ones from fresh on are already zero */
+static void
+clear_before(int8_t* block, size_t from, size_t to, size_t fresh)
+{
+    if (to > fresh)
+        to = fresh;
+
+    if (from < to)
+        memset(block + from, 0, to - from);
+}
+
+/* Grows the array geometrically until it can hold capacity elements, with a single realloc */
+static void
+grow(garray a, garray_index capacity)
+{
+    const garray_index previous_capacity = a->capacity;
+    const garray_index max = max_capacity(a);
+
+    if (capacity <= previous_capacity)
+        return;
+
+    if (capacity > max) {
+        perror("grow(): posible overflow of the garray_index type, try defining GARRAY_INDEX_64\n");
+        abort();
+    }
+
+    /*
+     * Growth starts at GARRAY_MIN_CAPACITY elements, doubling from a single element is all reallocs.
+     * A segmented array starts with its first segment and doubles with every next one
+     */
+    const garray_index min_capacity = a->segmented ? FIRST_SEGMENT : GARRAY_MIN_CAPACITY;
+    garray_index new_capacity = previous_capacity < min_capacity ? min_capacity : previous_capacity;
+
+    if (new_capacity > max)
+        new_capacity = max;
+
+    while (new_capacity < capacity) {
+        if (new_capacity > max >> 1) {
+            if (a->segmented) {
+                perror("grow(): posible overflow of the garray_index type, try defining GARRAY_INDEX_64\n");
+                abort();
+            }
+
+            new_capacity = max;
+            break;
+        }
+
+        new_capacity <<= 1;
+    }
+
+    /* New segments are added after the old ones, only the bitmaps are reallocated */
+    if (a->segmented)
+        add_segments(a, previous_capacity, new_capacity);
+
+    const size_t previous_data = a->segmented ? 0 : data_size(a, previous_capacity);
+    const size_t data = a->segmented ? 0 : data_size(a, new_capacity);
+    const size_t previous_allocation_values = a->bytes_allocated_values_setted;
+    a->bytes_allocated_values_setted = BITMAP_SIZE(a, new_capacity);
+
+    const size_t previous_size = block_size(previous_data, previous_allocation_values);
+    const size_t size = block_size(data, a->bytes_allocated_values_setted);
+
+    resize_block(a, previous_size, size, "grow(): realloc\n");
+
+    /*
+     * The bitmap moves up to make room for the new data, the summary is rebuilt after it. Only what was
+     * in the old block needs zeroing when the new bytes of a mapping are already zero, so they are not
+     * touched until they are written
+     */
+    const size_t fresh = zeroed_block(a, size) ? previous_size : size;
+    const size_t values_setted = bitmap_offset(data);
+
+    memmove(a->array + values_setted, a->array + bitmap_offset(previous_data), previous_allocation_values);
+    clear_before(a->array, values_setted + previous_allocation_values,
+                 values_setted + a->bytes_allocated_values_setted, fresh);
+    clear_before(a->array, previous_data, data, fresh);
+
+    /*
+     * The bitmaps of a segmented array do not depend on its capacity, which is published last for the
+     * readers of a concurrent array: the segments and bitmaps of the positions below it are in place
+     */
+    if (!a->segmented)
+        a->capacity = new_capacity;
+
+    resize_summary(a);
+    __atomic_store_n(&a->capacity, new_capacity, __ATOMIC_RELEASE);
+}
+
+/* Makes room for num_elements elements in an array that has nothing setted yet */
+static void
+preallocate(garray a, garray_index num_elements)
+{
+    if (num_elements <= a->capacity)
+        return;
+
+    if (a->segmented) {
+        grow(a, num_elements);
+        return;
+    }
+
+    if (num_elements > max_capacity(a)) {
+        perror("___garray_new_preallocated(): posible overflow of the garray_index type, try defining GARRAY_INDEX_64\n");
+        abort();
+    }
+
+    a->capacity = num_elements;
+    a->bytes_allocated_values_setted = BITMAP_SIZE(a, num_elements);
+
+    const size_t size = block_size(data_size(a, num_elements), a->bytes_allocated_values_setted);
+
+    a->array = allocate(a, size, "___garray_new_preallocated(): calloc\n");
+    clear_before(a->array, 0, size, zeroed_block(a, size) ? 0 : size);
+
+    resize_summary(a);
+}
+
+garray
+___garray_new_preallocated(garray_index num_elements_preallocated,
+                           garray_index element_size)
+{
+    garray a = ___garray_new(element_size);
+
+    preallocate(a, num_elements_preallocated);
+
+    return a;
+}
+
+static bool
+check_resizing(garray a)
+{
+    if (a->next_free < a->capacity)
+        return false;
+
+    grow(a, a->next_free + 1);
+
+    return true;
+}
+
+
+/*
+ * Paged arrays keep their elements in pages of PAGE_ELEMENTS elements, allocated on the first write to
+ * them and released when they become empty, so memory follows the touched pages and not the highest
+ * index. page_tables[t][p] is the page of the elements [(t * TABLE_PAGES + p) * PAGE_ELEMENTS, ...),
+ * NULL while nothing there is setted, and page_tables grows to cover the highest table written.
+ * A page is laid out as the block of a contiguous array: the data and then its values_setted.
+ * GARRAY_MAX_VALUE is never a position of a paged array, it is left as the end of the positions.
+ *
+ * Clones share page_tables: the directory, every table and every page end with a reference count, so
+ * cloning only takes a reference to the directory. A write first makes its own copy of every shared node
+ * on the way to its page, from the directory down, and drops a reference to the copied one, so a writer
+ * copies one table and one page per page it writes and never the pages it does not touch. A node whose
+ * count is 1 is only reachable from its parent and is written in place. The counts are atomic, clones
+ * can be used and freed by different threads as long as their allocator is thread safe.
+ */
+#define LOG_B2_PAGE_ELEMENTS 10
+#define PAGE_ELEMENTS ((garray_index)1 << LOG_B2_PAGE_ELEMENTS)
+#define PAGE_WORDS (PAGE_ELEMENTS >> LOG_B2_ELEMENTS_PER_NODE)
+#define LOG_B2_TABLE_PAGES 8
+#define TABLE_PAGES ((garray_index)1 << LOG_B2_TABLE_PAGES)
+#define LOG_B2_TABLE_ELEMENTS (LOG_B2_PAGE_ELEMENTS + LOG_B2_TABLE_PAGES)
+
+#define page_data_size(a) bitmap_offset(PAGE_ELEMENTS * (a)->element_size)
+#define page_size(a) (page_data_size(a) + PAGE_WORDS * sizeof(garray_word) + sizeof(size_t))
+#define page_bitmap(a, page) ((bitmap_t)((page) + page_data_size(a)))
+#define page_refs(a, page) ((size_t*)(page_bitmap(a, page) + PAGE_WORDS))
+#define table_size (TABLE_PAGES * sizeof(int8_t*) + sizeof(size_t))
+#define table_refs(table) ((size_t*)((table) + TABLE_PAGES))
+#define directory_size(num_tables) ((num_tables) * sizeof(int8_t**) + sizeof(size_t))
+#define directory_refs(a) ((size_t*)((a)->page_tables + (a)->num_page_tables))
+#define page_offset(position) ((position) & (PAGE_ELEMENTS - 1))
+#define page_start(position) ((position) & ~(PAGE_ELEMENTS - 1))
+#define page_element(a, page, position) ((page) + page_offset(position) * (a)->element_size)
+
+/* One past the last position that page_tables covers */
+static garray_index
+paged_end(garray a)
+{
+    if (a->num_page_tables > (GARRAY_MAX_VALUE >> LOG_B2_TABLE_ELEMENTS))
+        return GARRAY_MAX_VALUE;
+
+    return a->num_page_tables << LOG_B2_TABLE_ELEMENTS;
+}
+
+/* The page of position, NULL if it has not been allocated */
+static int8_t*
+find_page(garray a, garray_index position)
+{
+    const garray_index table = position >> LOG_B2_TABLE_ELEMENTS;
+
+    if (table >= a->num_page_tables || a->page_tables[table] == NULL)
+        return NULL;
+
+    return a->page_tables[table][(position >> LOG_B2_PAGE_ELEMENTS) & (TABLE_PAGES - 1)];
+}
+
+/* Takes one more reference to a node of page_tables */
+#define add_reference(refs) __atomic_fetch_add(refs, 1, __ATOMIC_RELAXED)
+
+/* Whether a node of page_tables is reachable from more than one parent, or from more than one array */
+#define is_shared(refs) (__atomic_load_n(refs, __ATOMIC_ACQUIRE) > 1)
+
+/* Drops a reference to a node of page_tables, true if it was the last one and the node has to be freed */
+static bool
+drop_reference(size_t* refs)
+{
+    return !is_shared(refs) || __atomic_sub_fetch(refs, 1, __ATOMIC_ACQ_REL) == 0;
+}
+
+static void
+release_page(garray a, int8_t* page)
+{
+    if (page != NULL && drop_reference(page_refs(a, page)))
+        deallocate(a, page, page_size(a));
+}
+
+static void
+release_table(garray a, int8_t** table)
+{
+    if (table == NULL || !drop_reference(table_refs(table)))
+        return;
+
+    for (garray_index page = 0; page < TABLE_PAGES; page++)
+        release_page(a, table[page]);
+
+    deallocate(a, table, table_size);
+}
+
+/* Drops the reference of a to page_tables, freeing whatever no other clone uses */
+static void
+release_directory(garray a)
+{
+    if (a->page_tables == NULL || !drop_reference(directory_refs(a)))
+        return;
+
+    for (garray_index table = 0; table < a->num_page_tables; table++)
+        release_table(a, a->page_tables[table]);
+
+    deallocate(a, a->page_tables, directory_size(a->num_page_tables));
+}
+
+/* Copies page_tables if a clone shares it, so that its entries can be written */
+static void
+own_directory(garray a)
+{
+    if (a->page_tables == NULL || !is_shared(directory_refs(a)))
+        return;
+
+    int8_t*** tables = allocate(a, directory_size(a->num_page_tables), "garray_set(): malloc\n");
+
+    for (garray_index table = 0; table < a->num_page_tables; table++) {
+        tables[table] = a->page_tables[table];
+
+        if (tables[table] != NULL)
+            add_reference(table_refs(tables[table]));
+    }
+
+    release_directory(a);
+    a->page_tables = tables;
+    *directory_refs(a) = 1;
+}
+
+/* The table of position ready to be written, copied if it is shared and allocated if missing and create */
+static int8_t**
+own_table(garray a, garray_index position, bool create)
+{
+    int8_t*** table = &a->page_tables[position >> LOG_B2_TABLE_ELEMENTS];
+
+    if (*table == NULL) {
+        if (!create)
+            return NULL;
+
+        *table = allocate(a, table_size, "garray_set(): malloc\n");
+        memset(*table, 0, TABLE_PAGES * sizeof(int8_t*));
+        *table_refs(*table) = 1;
+    } else if (is_shared(table_refs(*table))) {
+        int8_t** copy = allocate(a, table_size, "garray_set(): malloc\n");
+
+        for (garray_index page = 0; page < TABLE_PAGES; page++) {
+            copy[page] = (*table)[page];
+
+            if (copy[page] != NULL)
+                add_reference(page_refs(a, copy[page]));
+        }
+
+        release_table(a, *table);
+        *table = copy;
+        *table_refs(copy) = 1;
+    }
+
+    return *table;
+}
+
+/*
+ * The page of position ready to be written: every node above it and the page itself are copied if a clone
+ * shares them. A missing page, or table, is allocated if create and returned as NULL otherwise
+ */
+static int8_t*
+own_page(garray a, garray_index position, bool create)
+{
+    const garray_index table = position >> LOG_B2_TABLE_ELEMENTS;
+
+    own_directory(a);
+
+    if (table >= a->num_page_tables) {
+        if (!create)
+            return NULL;
+
+        garray_index num_tables = a->num_page_tables == 0 ? 1 : a->num_page_tables;
+
+        while (num_tables <= table)
+            num_tables <<= 1;
+
+        ARRAY_REALLOC(a, a->page_tables, a->page_tables == NULL ? 0 : directory_size(a->num_page_tables),
+                      directory_size(num_tables), "garray_set(): realloc\n");
+        memset(a->page_tables + a->num_page_tables, 0, (num_tables - a->num_page_tables) * sizeof(int8_t**));
+        a->num_page_tables = num_tables;
+        *directory_refs(a) = 1;
+    }
+
+    int8_t** tables = own_table(a, position, create);
+
+    if (tables == NULL)
+        return NULL;
+
+    int8_t** page = &tables[(position >> LOG_B2_PAGE_ELEMENTS) & (TABLE_PAGES - 1)];
+
+    if (*page == NULL) {
+        if (!create)
+            return NULL;
+
+        *page = allocate(a, page_size(a), "garray_set(): malloc\n");
+        memset(page_bitmap(a, *page), 0, PAGE_WORDS * sizeof(garray_word));
+        *page_refs(a, *page) = 1;
+    } else if (is_shared(page_refs(a, *page))) {
+        int8_t* copy = allocate(a, page_size(a), "garray_set(): malloc\n");
+
+        memcpy(copy, *page, page_size(a));
+        release_page(a, *page);
+        *page = copy;
+        *page_refs(a, copy) = 1;
+    }
+
+    return *page;
+}
+
+/* Same as find_page() but allocates the page, and the table and the directory above it, if missing */
+static int8_t*
+touch_page(garray a, garray_index position)
+{
+    if (position == GARRAY_MAX_VALUE) {
+        perror("garray_set(): position out of bounds\n");
+        abort();
+    }
+
+    return own_page(a, position, true);
+}
+
+/* Frees the page of position if nothing in it is setted */
+static void
+release_page_if_empty(garray a, garray_index position)
+{
+    int8_t* page = find_page(a, position);
+
+    if (page == NULL)
+        return;
+
+    bitmap_t bitmap = page_bitmap(a, page);
+
+    for (garray_index word = 0; word < PAGE_WORDS; word++)
+        if (bitmap[word] != 0)
+            return;
+
+    own_directory(a);
+
+    int8_t** table = own_table(a, position, false);
+
+    release_page(a, table[(position >> LOG_B2_PAGE_ELEMENTS) & (TABLE_PAGES - 1)]);
+    table[(position >> LOG_B2_PAGE_ELEMENTS) & (TABLE_PAGES - 1)] = NULL;
+}
+
+/* First offset in [from, PAGE_ELEMENTS) of the bitmap of a page whose bit is setted, PAGE_ELEMENTS if none */
+static garray_index
+page_next(bitmap_t bitmap, garray_index from, bool setted)
+{
+    const garray_word flip = setted ? 0 : GARRAY_WORD_FULL;
+    garray_index word = from >> LOG_B2_ELEMENTS_PER_NODE;
+    garray_word bits = (bitmap[word] ^ flip) & (GARRAY_WORD_FULL << (from % ELEMENTS_PER_NODE));
+
+    while (bits == 0) {
+        if (++word == PAGE_WORDS)
+            return PAGE_ELEMENTS;
+
+        bits = bitmap[word] ^ flip;
+    }
+
+    return (word << LOG_B2_ELEMENTS_PER_NODE) + GARRAY_CTZ(bits);
+}
+
+/* The element at position, NULL if it is not setted */
+static int8_t*
+paged_at(garray a, garray_index position)
+{
+    int8_t* page = find_page(a, position);
+
+    if (page == NULL || !(page_bitmap(a, page)[page_offset(position) >> LOG_B2_ELEMENTS_PER_NODE] &
+                          ((garray_word)1 << (position % ELEMENTS_PER_NODE))))
+        return NULL;
+
+    return page_element(a, page, position);
+}
+
+static void
+paged_set(garray a, garray_index position, const void* data)
+{
+    int8_t* page = touch_page(a, position);
+
+    memcpy(page_element(a, page, position), data, a->element_size);
+    a->num_elements += mark_bits(page_bitmap(a, page), page_offset(position), page_offset(position) + 1, true);
+}
+
+static void
+paged_remove(garray a, garray_index position)
+{
+    if (paged_at(a, position) == NULL)
+        return;
+
+    mark_bits(page_bitmap(a, own_page(a, position, false)), page_offset(position), page_offset(position) + 1, false);
+
+    a->num_elements--;
+
+    if (position < a->next_free)
+        a->next_free = position;
+
+    release_page_if_empty(a, position);
+}
+
+/* Returns the first position from from on that is not setted, missing pages are not setted at all */
+static garray_index
+paged_next_unsetted(garray a, garray_index from)
+{
+    for (;;) {
+        int8_t* page = find_page(a, from);
+
+        if (page == NULL)
+            return from;
+
+        garray_index offset = page_next(page_bitmap(a, page), page_offset(from), false);
+
+        if (offset < PAGE_ELEMENTS)
+            return page_start(from) + offset;
+
+        from = page_start(from) + PAGE_ELEMENTS;
+
+        if (from == 0) {
+            perror("garray_add(): every position of the array is setted\n");
+            abort();
+        }
+    }
+}
+
+/* Same as next_setted() for a paged array, whole missing tables and pages are skipped */
+static garray_index
+paged_next_setted(garray a, garray_index from, garray_index end)
+{
+    while (from < end) {
+        const garray_index table = from >> LOG_B2_TABLE_ELEMENTS;
+        garray_index next;
+
+        if (table >= a->num_page_tables)
+            return end;
+
+        if (a->page_tables[table] == NULL)
+            next = (from | (((garray_index)1 << LOG_B2_TABLE_ELEMENTS) - 1)) + 1;
+        else {
+            int8_t* page = a->page_tables[table][(from >> LOG_B2_PAGE_ELEMENTS) & (TABLE_PAGES - 1)];
+
+            if (page != NULL) {
+                garray_index offset = page_next(page_bitmap(a, page), page_offset(from), true);
+
+                if (offset < PAGE_ELEMENTS)
+                    return page_start(from) + offset < end ? page_start(from) + offset : end;
+            }
+
+            next = page_start(from) + PAGE_ELEMENTS;
+        }
+
+        /* Past the last position */
+        if (next == 0)
+            return end;
+
+        from = next;
+    }
+
+    return end;
+}
+
+/* Same as previous_setted() for a paged array */
+static bool
+paged_previous_setted(garray a, garray_index from, garray_index* found)
+{
+    if (a->num_page_tables == 0)
+        return false;
+
+    if (from >= paged_end(a))
+        from = paged_end(a) - 1;
+
+    for (;;) {
+        int8_t* page = find_page(a, from);
+
+        if (page != NULL) {
+            bitmap_t bitmap = page_bitmap(a, page);
+            garray_index word = page_offset(from) >> LOG_B2_ELEMENTS_PER_NODE;
+            garray_word bits = bitmap[word] & (GARRAY_WORD_FULL >> (ELEMENTS_PER_NODE - 1 - from % ELEMENTS_PER_NODE));
+
+            while (bits == 0 && word > 0)
+                bits = bitmap[--word];
+
+            if (bits != 0) {
+                *found = page_start(from) + (word << LOG_B2_ELEMENTS_PER_NODE) + (ELEMENTS_PER_NODE - 1) -
+                         GARRAY_CLZ(bits);
+                return true;
+            }
+        }
+
+        if (page_start(from) == 0)
+            return false;
+
+        from = page_start(from) - 1;
+    }
+}
+
+/* Shares every page of a with the empty paged array new_a, they are copied as they are written */
+static void
+paged_clone(garray a, garray new_a)
+{
+    if (a->page_tables != NULL)
+        add_reference(directory_refs(a));
+
+    new_a->page_tables = a->page_tables;
+    new_a->num_page_tables = a->num_page_tables;
+    new_a->num_elements = a->num_elements;
+    new_a->next_free = a->next_free;
+}
+
+/* Moves every element, in order, to the positions [0, num_elements) and frees the pages left empty */
+static void
+paged_collapse(garray a)
+{
+    const garray_index end = paged_end(a);
+    garray_index to = 0;
+
+    for (garray_index from = paged_next_setted(a, 0, end); from < end; from = paged_next_setted(a, from + 1, end)) {
+        if (from != to) {
+            int8_t* to_page = touch_page(a, to);
+            int8_t* page = own_page(a, from, false);
+
+            memcpy(page_element(a, to_page, to), page_element(a, page, from), a->element_size);
+            mark_bits(page_bitmap(a, to_page), page_offset(to), page_offset(to) + 1, true);
+            mark_bits(page_bitmap(a, page), page_offset(from), page_offset(from) + 1, false);
+        }
+
+        to++;
+    }
+
+    for (garray_index position = 0; position < end; position += PAGE_ELEMENTS) {
+        release_page_if_empty(a, position);
+
+        if (position + PAGE_ELEMENTS < position)
+            break;
+    }
+
+    a->next_free = a->num_elements;
+}
+
+/* One past the last position that can be setted without growing the array */
+#define index_end(a) ((a)->paged ? paged_end(a) : get_capacity(a))
+
+/* The setted element at position, of any kind of array */
+#define element(a, position) ((a)->paged ? paged_at(a, position) : get_element(a, position))
+
+/* Number of elements from position that are contiguous in memory, in any kind of array */
+#define run_at(a, position) ((a)->paged ? PAGE_ELEMENTS - page_offset(position) : contiguous_run(a, position))
+
+/* The element a struct garray_foreach is at */
+#define foreach_element(a, it) ___garray_foreach_get(it, (a)->element_size)
+
+bool
+___garray_foreach_next_page(struct garray_foreach* it)
+{
+    garray a = it->garray;
+    const garray_index num_pages = a->num_page_tables << LOG_B2_TABLE_PAGES;
+
+    while (it->page < num_pages) {
+        int8_t** table = a->page_tables[it->page >> LOG_B2_TABLE_PAGES];
+
+        if (table == NULL) {
+            it->page = ((it->page >> LOG_B2_TABLE_PAGES) + 1) << LOG_B2_TABLE_PAGES;
+            continue;
+        }
+
+        int8_t* page = table[it->page & (TABLE_PAGES - 1)];
+
+        if (page == NULL) {
+            it->page++;
+            continue;
+        }
+
+        it->words = page_bitmap(a, page);
+        it->num_words = PAGE_WORDS;
+        it->word = 0;
+        it->bits = it->words[0];
+        it->data = page;
+        it->first = it->page++ << LOG_B2_PAGE_ELEMENTS;
+
+        return true;
+    }
+
+    return false;
+}
+
+/* Returns the index of the first setted element in [from, end), end if there is none */
+static garray_index
+next_setted(garray a, garray_index from, garray_index end)
+{
+    if (from >= end)
+        return end;
+
+    if (a->dense)
+        return from < a->num_elements ? from : end;
+
+    if (a->paged)
+        return paged_next_setted(a, from, end);
+
+    garray_index word = from >> LOG_B2_ELEMENTS_PER_NODE;
+    const garray_index last_word = (end - 1) >> LOG_B2_ELEMENTS_PER_NODE;
+    garray_word bits = a->values_setted[word] & (GARRAY_WORD_FULL << (from % ELEMENTS_PER_NODE));
+
+    while (bits == 0) {
+        if (++word > last_word)
+            return end;
+
+        bits = a->values_setted[word];
+    }
+
+    from = (word << LOG_B2_ELEMENTS_PER_NODE) + GARRAY_CTZ(bits);
+
+    return from < end ? from : end;
+}
+
+/* Same as next_setted() but looks for an unsetted element */
+static garray_index
+next_unsetted(garray a, garray_index from, garray_index end)
+{
+    if (from >= end)
+        return end;
+
+    garray_index word = from >> LOG_B2_ELEMENTS_PER_NODE;
+    const garray_index last_word = (end - 1) >> LOG_B2_ELEMENTS_PER_NODE;
+    garray_word bits = ~a->values_setted[word] & (GARRAY_WORD_FULL << (from % ELEMENTS_PER_NODE));
+
+    while (bits == 0) {
+        if (++word > last_word)
+            return end;
+
+        bits = ~a->values_setted[word];
+    }
+
+    from = (word << LOG_B2_ELEMENTS_PER_NODE) + GARRAY_CTZ(bits);
+
+    return from < end ? from : end;
+}
+
+/* Stores in *found the index of the last setted element in [0, from], returns false if there is none */
+static bool
+previous_setted(garray a, garray_index from, garray_index* found)
+{
+    if (a->dense) {
+        if (a->num_elements == 0)
+            return false;
+
+        *found = from < a->num_elements ? from : a->num_elements - 1;
+
+        return true;
+    }
+
+    if (a->paged)
+        return paged_previous_setted(a, from, found);
+
+    garray_index word = from >> LOG_B2_ELEMENTS_PER_NODE;
+    garray_word bits = a->values_setted[word] &
+                       (GARRAY_WORD_FULL >> (ELEMENTS_PER_NODE - 1 - from % ELEMENTS_PER_NODE));
+
+    while (bits == 0) {
+        if (word-- == 0)
+            return false;
+
+        bits = a->values_setted[word];
+    }
+
+    *found = (word << LOG_B2_ELEMENTS_PER_NODE) + (ELEMENTS_PER_NODE - 1) - GARRAY_CLZ(bits);
+
+    return true;
+}
+
+/* Invariant: there are no unsetted elements before next_free */
+static garray_index
+get_next_free(garray a)
+{
+    a->next_free = summary_next_unsetted(a, 0, a->next_free, get_capacity(a));
+
+    /* Every element is setted, the next free is the first of the new space */
+    check_resizing(a);
+
+    return a->next_free;
+}
+
+/* Counts the calling thread as a writer of a concurrent array, once no other thread is growing it */
+static void
+writers_enter(struct garray_concurrent* concurrent)
+{
+    while (atomic_fetch_add(&concurrent->writers, 1) & WRITERS_GROWING) {
+        atomic_fetch_sub(&concurrent->writers, 1);
+
+        /* The thread growing the array holds the lock until it is done */
+        pthread_mutex_lock(&concurrent->growing);
+        pthread_mutex_unlock(&concurrent->growing);
+    }
+}
+
+#define writers_leave(concurrent) atomic_fetch_sub(&(concurrent)->writers, 1)
+
+/* Positions a writer of a concurrent array can use, the array may have been grown by a call that was not */
+static garray_index
+concurrent_capacity(garray a)
+{
+    const garray_index capacity = __atomic_load_n(&a->capacity, __ATOMIC_ACQUIRE);
+
+    return capacity < a->concurrent->pending_capacity ? capacity : a->concurrent->pending_capacity;
+}
+
+/* Grows a concurrent array, and its pending, to hold capacity elements. Called by a writer */
+static void
+concurrent_grow(garray a, garray_index capacity)
+{
+    struct garray_concurrent* concurrent = a->concurrent;
+
+    writers_leave(concurrent);
+    pthread_mutex_lock(&concurrent->growing);
+
+    /* Another writer may have grown it while this one waited */
+    if (capacity > concurrent_capacity(a)) {
+        atomic_fetch_or(&concurrent->writers, WRITERS_GROWING);
+
+        while ((atomic_load(&concurrent->writers) & ~WRITERS_GROWING) != 0)
+            sched_yield();
+
+        grow(a, capacity);
+
+        const size_t previous_size = VALUES_SETTED_SIZE(concurrent->pending_capacity);
+        const size_t size = VALUES_SETTED_SIZE(a->capacity);
+
+        /* Only writers look at pending and there are none, it is reallocated as usual */
+        if (size > previous_size) {
+            ARRAY_REALLOC(a, concurrent->pending, previous_size, size, "grow(): realloc\n");
+            memset((int8_t*)concurrent->pending + previous_size, 0, size - previous_size);
+        }
+
+        concurrent->pending_capacity = a->capacity;
+        atomic_fetch_and(&concurrent->writers, ~WRITERS_GROWING);
+    }
+
+    pthread_mutex_unlock(&concurrent->growing);
+    writers_enter(concurrent);
+}
+
+/*
+ * Makes every level of full_summary over the word of values_setted agree with it. Other threads may be
+ * changing the same words, so each level is checked again after it is written: the last thread to change
+ * a word is the last to write the bit over it
+ */
+static void
+concurrent_sync_summary(garray a, garray_index word)
+{
+    bitmap_t below = a->values_setted;
+
+    for (int level = 0; level < GARRAY_SUMMARY_LEVELS && a->full_summary[level] != NULL; level++) {
+        garray_word* summary = &a->full_summary[level][word >> LOG_B2_ELEMENTS_PER_NODE];
+        const garray_word bit = (garray_word)1 << (word % ELEMENTS_PER_NODE);
+        garray_word value;
+
+        do {
+            value = __atomic_load_n(&below[word], __ATOMIC_SEQ_CST);
+
+            if ((value == GARRAY_WORD_FULL) != ((__atomic_load_n(summary, __ATOMIC_SEQ_CST) & bit) != 0)) {
+                if (value == GARRAY_WORD_FULL)
+                    __atomic_fetch_or(summary, bit, __ATOMIC_SEQ_CST);
+                else
+                    __atomic_fetch_and(summary, ~bit, __ATOMIC_SEQ_CST);
+            }
+        } while (__atomic_load_n(&below[word], __ATOMIC_SEQ_CST) != value);
+
+        below = a->full_summary[level];
+        word >>= LOG_B2_ELEMENTS_PER_NODE;
+    }
+}
+
+/* Lowers next_free to position if it is above */
+static void
+lower_next_free(garray a, garray_index position)
+{
+    garray_index next_free = __atomic_load_n(&a->next_free, __ATOMIC_SEQ_CST);
+
+    while (position < next_free &&
+           !__atomic_compare_exchange_n(&a->next_free, &next_free, position, true, __ATOMIC_SEQ_CST,
+                                        __ATOMIC_SEQ_CST))
+        ;
+}
+
+/* First position in [from, end) neither setted nor pending, end if there is none */
+static garray_index
+concurrent_next_free(garray a, garray_index from, garray_index end)
+{
+    if (from >= end)
+        return end;
+
+    garray_index word = from >> LOG_B2_ELEMENTS_PER_NODE;
+    const garray_index last_word = (end - 1) >> LOG_B2_ELEMENTS_PER_NODE;
+    garray_word mask = GARRAY_WORD_FULL << (from % ELEMENTS_PER_NODE), bits;
+
+    while ((bits = ~(__atomic_load_n(&a->values_setted[word], __ATOMIC_SEQ_CST) |
+                     __atomic_load_n(&a->concurrent->pending[word], __ATOMIC_SEQ_CST)) & mask) == 0) {
+        if (++word > last_word)
+            return end;
+
+        mask = GARRAY_WORD_FULL;
+    }
+
+    from = (word << LOG_B2_ELEMENTS_PER_NODE) + GARRAY_CTZ(bits);
+
+    return from < end ? from : end;
+}
+
+/*
+ * ___garray_add() of a concurrent array. The first free position from next_free is claimed in pending,
+ * losing the race for it to another writer only means looking again
+ */
+static garray_index
+concurrent_add(garray a, const void* data)
+{
+    struct garray_concurrent* concurrent = a->concurrent;
+
+    writers_enter(concurrent);
+
+    for (;;) {
+        const garray_index capacity = concurrent_capacity(a);
+        const garray_index from = __atomic_load_n(&a->next_free, __ATOMIC_SEQ_CST);
+        const garray_index position = concurrent_next_free(a, from, capacity);
+
+        if (position == capacity) {
+            concurrent_grow(a, capacity + 1);
+            continue;
+        }
+
+        const garray_index word = position >> LOG_B2_ELEMENTS_PER_NODE;
+        const garray_word bit = (garray_word)1 << (position % ELEMENTS_PER_NODE);
+
+        if (__atomic_fetch_or(&concurrent->pending[word], bit, __ATOMIC_SEQ_CST) & bit)
+            continue;
+
+        /* A set() may have published it after it was found free */
+        if (__atomic_load_n(&a->values_setted[word], __ATOMIC_SEQ_CST) & bit) {
+            __atomic_fetch_and(&concurrent->pending[word], ~bit, __ATOMIC_SEQ_CST);
+            continue;
+        }
+
+        memcpy(get_element(a, position), data, a->element_size);
+        __atomic_fetch_or(&a->values_setted[word], bit, __ATOMIC_SEQ_CST);
+        __atomic_fetch_and(&concurrent->pending[word], ~bit, __ATOMIC_SEQ_CST);
+        __atomic_fetch_add(&a->num_elements, 1, __ATOMIC_SEQ_CST);
+        concurrent_sync_summary(a, word);
+
+        /*
+         * Everything in [from, position) was setted or pending, so next_free can move past position. A
+         * remove() in there that did not lower next_free because it was still at from is caught after
+         */
+        garray_index expected = from;
+
+        if (__atomic_compare_exchange_n(&a->next_free, &expected, position + 1, false, __ATOMIC_SEQ_CST,
+                                        __ATOMIC_SEQ_CST))
+            lower_next_free(a, concurrent_next_free(a, from, position));
+
+        writers_leave(concurrent);
+
+        return position;
+    }
+}
+
+/* ___garray_set() of a concurrent array, it waits for a writer that has the position pending */
+static void
+concurrent_set(garray a, garray_index position, const void* restrict data)
+{
+    struct garray_concurrent* concurrent = a->concurrent;
+
+    writers_enter(concurrent);
+
+    while (position >= concurrent_capacity(a))
+        concurrent_grow(a, position + 1);
+
+    const garray_index word = position >> LOG_B2_ELEMENTS_PER_NODE;
+    const garray_word bit = (garray_word)1 << (position % ELEMENTS_PER_NODE);
+
+    while (__atomic_fetch_or(&concurrent->pending[word], bit, __ATOMIC_SEQ_CST) & bit)
+        sched_yield();
+
+    memcpy(get_element(a, position), data, a->element_size);
+
+    const bool setted = __atomic_fetch_or(&a->values_setted[word], bit, __ATOMIC_SEQ_CST) & bit;
+
+    __atomic_fetch_and(&concurrent->pending[word], ~bit, __ATOMIC_SEQ_CST);
+
+    if (!setted) {
+        __atomic_fetch_add(&a->num_elements, 1, __ATOMIC_SEQ_CST);
+        concurrent_sync_summary(a, word);
+    }
+
+    writers_leave(concurrent);
+}
+
+/*
+ * ___garray_remove() of a concurrent array, a position still pending was not added yet and is left. It is
+ * bound by the capacity, not by pending: a bulk add or a read grows the array without growing pending
+ */
+static void
+concurrent_remove(garray a, garray_index position)
+{
+    struct garray_concurrent* concurrent = a->concurrent;
+
+    writers_enter(concurrent);
+
+    if (position < __atomic_load_n(&a->capacity, __ATOMIC_ACQUIRE)) {
+        const garray_index word = position >> LOG_B2_ELEMENTS_PER_NODE;
+        const garray_word bit = (garray_word)1 << (position % ELEMENTS_PER_NODE);
+
+        if (__atomic_fetch_and(&a->values_setted[word], ~bit, __ATOMIC_SEQ_CST) & bit) {
+            __atomic_fetch_sub(&a->num_elements, 1, __ATOMIC_SEQ_CST);
+            concurrent_sync_summary(a, word);
+            lower_next_free(a, position);
+        }
+    }
+
+    writers_leave(concurrent);
+}
+
+/* ___garray_at_default() of a concurrent array, the bit is read before the element it publishes */
+static const void*
+concurrent_at(garray a, garray_index position, const void* default_value)
+{
+    if (position >= __atomic_load_n(&a->capacity, __ATOMIC_ACQUIRE))
+        return default_value;
+
+    const bitmap_t values_setted = __atomic_load_n(&a->values_setted, __ATOMIC_ACQUIRE);
+    const garray_word bits = __atomic_load_n(&values_setted[position >> LOG_B2_ELEMENTS_PER_NODE],
+                                             __ATOMIC_ACQUIRE);
+
+    if ((bits & ((garray_word)1 << (position % ELEMENTS_PER_NODE))) == 0)
+        return default_value;
+
+    return get_element(a, position);
+}
+
+/* One past the span of setted elements from the setted position start, they are contiguous in memory */
+static garray_index
+span_end(garray a, garray_index start, garray_index capacity)
+{
+    garray_index end;
+
+    /* Full words are skipped through full_summary, a dense array is a single span and a paged one ends spans with its pages */
+    if (a->dense)
+        end = a->num_elements;
+    else if (a->paged)
+        end = page_start(start) + page_next(page_bitmap(a, find_page(a, start)), page_offset(start), false);
+    else
+        end = summary_next_unsetted(a, 0, start, capacity);
+
+    /* Nor do spans of a segmented array cross segments */
+    if (a->segmented && end - start > contiguous_run(a, start))
+        end = start + contiguous_run(a, start);
+
+    return end;
+}
+
+/*
+ * Compaction keeps the order of the elements: the span of setted elements right after the first hole is
+ * moved down into it with a single memmove(), so each step costs a bitmap scan and a bulk copy and
+ * elements only move down. Runs are cut where either end stops being contiguous in memory, at the end of
+ * a page or of a segment. The first hole is looked for from next_free, that is never past it
+ */
+struct garray_compaction {
+    double max_hole_ratio;      //Compaction starts when holes reach this share of the positions in use
+    garray_index step_elements; //Elements moved by each remove while compacting
+    garray_index holes;         //Removes since the last compaction, at least as many as the holes
+    bool running;               //A compaction started by the policy is not finished
+};
+
+/*
+ * Moves the span of setted elements after the first hole down into it, up to max_elements of them, and
+ * returns how many were moved. Returns 0 once no setted element is left after a hole. Nothing is setted
+ * between the first hole and *read, that is moved past the span, so the holes left behind are not
+ * scanned again by the next run
+ */
+static garray_index
+compact_run(garray a, garray_index* read, garray_index max_elements)
+{
+    const garray_index end = index_end(a);
+    garray_index to = a->paged ? paged_next_unsetted(a, a->next_free) : next_unsetted(a, a->next_free, end);
+    garray_index from = to < end ? next_setted(a, *read > to ? *read : to, end) : end;
+
+    a->next_free = to;
+
+    if (from >= end || max_elements == 0)
+        return 0;
+
+    garray_index run = span_end(a, from, end) - from;
+
+    if (run > run_at(a, to))
+        run = run_at(a, to);
+
+    if (run > max_elements)
+        run = max_elements;
+
+    /* The positions past the new end of the run and up to the old one are left unsetted */
+    const garray_index vacated = to + run > from ? to + run : from;
+
+    if (a->paged) {
+        int8_t* to_page = touch_page(a, to);
+        int8_t* page = own_page(a, from, false);
+
+        memmove(page_element(a, to_page, to), page_element(a, page, from), (size_t)run * a->element_size);
+        mark_bits(page_bitmap(a, to_page), page_offset(to), page_offset(to) + run, true);
+        mark_bits(page_bitmap(a, page), page_offset(vacated), page_offset(from) + run, false);
+        release_page_if_empty(a, from);
+    } else {
+        memmove(get_element(a, to), get_element(a, from), (size_t)run * a->element_size);
+        mark_range(a, to, to + run, true);
+        mark_range(a, vacated, from + run, false);
+    }
+
+    a->next_free = to + run;
+    *read = from + run;
+
+    return run;
+}
+
+/* Moves up to max_elements elements, returns true once every element is before every hole */
+static bool
+compact_step(garray a, garray_index max_elements)
+{
+    garray_index moved = 0, run = 1, read = 0;
+
+    while (moved < max_elements && (run = compact_run(a, &read, max_elements - moved)) > 0)
+        moved += run;
+
+    return run == 0;
+}
+
+/* Forgets the holes counted by the policy once the array has no holes */
+#define compaction_done(a)                                                                                \
+    ((a)->compaction != NULL ? (void)((a)->compaction->holes = 0, (a)->compaction->running = false) : (void)0)
+
+/* Counts removed holes and, past the hole ratio of the policy, moves a step of elements */
+static void
+auto_compact(garray a, garray_index removed)
+{
+    struct garray_compaction* compaction = a->compaction;
+
+    compaction->holes = removed > GARRAY_MAX_VALUE - compaction->holes ? GARRAY_MAX_VALUE : compaction->holes + removed;
+
+    if (!compaction->running &&
+        compaction->holes < compaction->max_hole_ratio * ((double)a->num_elements + compaction->holes))
+        return;
+
+    compaction->running = !compact_step(a, compaction->step_elements);
+
+    if (!compaction->running)
+        compaction_done(a);
+}
+
+garray_index
+___garray_add(garray a, const void* data)
+{
+    if (a->concurrent != NULL)
+        return concurrent_add(a, data);
+
+    if (a->dense) {
+        grow(a, a->num_elements + 1);
+        memcpy(get_element(a, a->num_elements), data, a->element_size);
+        a->next_free = a->num_elements + 1;
+
+        return a->num_elements++;
+    }
+
+    if (a->paged) {
+        garray_index pos = a->next_free = paged_next_unsetted(a, a->next_free);
+
+        paged_set(a, pos, data);
+        a->next_free++;
+
+        return pos;
+    }
+
+    garray_index pos = get_next_free(a);
+
+    memcpy(get_element(a, pos), data, a->element_size);
+    mark_setted(a, pos);
+    a->num_elements++;
+    a->next_free++;
+
+    return pos;
+}
+
+const void*
+___garray_at(garray a, garray_index position)
+{
+    if (a->concurrent != NULL) {
+        const void* element = concurrent_at(a, position, NULL);
+
+        if (element == NULL) {
+            perror("garray_at(): position out of bounds or not setted\n");
+            abort();
+        }
+
+        return element;
+    }
+
+    if (a->paged) {
+        const void* element = paged_at(a, position);
+
+        if (element == NULL) {
+            perror("garray_at(): position not setted\n");
+            abort();
+        }
+
+        return element;
+    }
+
+    if (position >= a->capacity) {
+        perror("garray_at(): position out of bounds\n");
+        abort();
+    }
+
+    if (!IS_SETTED(a, position)) {
+        perror("garray_at(): position not setted\n");
+        abort();
+    }
+
+    return get_element(a, position);
+}
+
+const void*
+___garray_at_default(garray a, garray_index position, const void* default_value)
+{
+    if (a->concurrent != NULL)
+        return concurrent_at(a, position, default_value);
+
+    if (a->paged) {
+        const void* element = paged_at(a, position);
+
+        return element == NULL ? default_value : element;
+    }
+
+    if (position >= a->capacity)
+        return default_value;
+
+    if (!IS_SETTED(a, position))
+        return default_value;
+
+    return get_element(a, position);
+}
+
+void
+___garray_set(garray a, garray_index position, const void* restrict data)
+{
+    if (a->concurrent != NULL) {
+        concurrent_set(a, position, data);
+        return;
+    }
+
+    /* A dense array can only overwrite or append */
+    if (a->dense) {
+        if (position == a->num_elements)
+            ___garray_add(a, data);
+        else if (position < a->num_elements)
+            memcpy(get_element(a, position), data, a->element_size);
+        else {
+            perror("garray_set(): position past the end of a dense array\n");
+            abort();
+        }
+
+        return;
+    }
+
+    if (a->paged) {
+        paged_set(a, position, data);
+        return;
+    }
+
+    if (position >= a->capacity)
+        grow(a, position + 1);
+
+    memcpy(get_element(a, position), data, a->element_size);
+
+    if (!mark_setted(a, position))
+        a->num_elements++;
+}
+
+void
+___garray_remove(garray a, garray_index position)
+{
+    if (a->concurrent != NULL) {
+        concurrent_remove(a, position);
+        return;
+    }
+
+    /* The last element fills the hole */
+    if (a->dense) {
+        if (position >= a->num_elements)
+            return;
+
+        a->next_free = --a->num_elements;
+
+        if (position != a->num_elements)
+            memcpy(get_element(a, position), get_element(a, a->num_elements), a->element_size);
+
+        return;
+    }
+
+    if (a->paged)
+        paged_remove(a, position);
+    else {
+        if (!mark_unsetted(a, position))
+            return;
+
+        a->num_elements--;
+
+        if (position < a->next_free)
+            a->next_free = position;
+    }
+
+    if (a->compaction != NULL)
+        auto_compact(a, 1);
+}
+
+void
+___garray_add_many(garray a, const void* data, garray_index n)
+{
+    const int8_t* from = data;
+    garray_index capacity = get_capacity(a);
+
+    if (a->dense) {
+        if (n > GARRAY_MAX_VALUE - a->num_elements) {
+            perror("___garray_add_many(): posible overflow of the garray_index type\n");
+            abort();
+        }
+
+        grow(a, a->num_elements + n);
+        memcpy(get_element(a, a->num_elements), from, (size_t)n * a->element_size);
+        a->num_elements += n;
+        a->next_free = a->num_elements;
+
+        return;
+    }
+
+    if (a->paged) {
+        for (; n > 0; n--, from += a->element_size)
+            ___garray_add(a, from);
+
+        return;
+    }
+
+    while (n > 0) {
+        garray_index pos = summary_next_unsetted(a, 0, a->next_free, capacity);
+
+        /* No holes left, everything else goes after the end with a single growth */
+        if (pos == capacity) {
+            if (n > GARRAY_MAX_VALUE - capacity) {
+                perror("___garray_add_many(): posible overflow of the garray_index type\n");
+                abort();
+            }
+
+            grow(a, capacity + n);
+            capacity = get_capacity(a);
+        }
+
+        garray_index run = next_setted(a, pos, capacity) - pos;
+
+        if (run > n)
+            run = n;
+
+        copy_to(a, pos, from, run);
+        mark_range(a, pos, pos + run, true);
+
+        a->num_elements += run;
+        a->next_free = pos + run;
+        from += run * a->element_size;
+        n -= run;
+    }
+}
+
+void
+___garray_set_range(garray a, garray_index position, const void* restrict data, garray_index n)
+{
+    if (n == 0)
+        return;
+
+    if (n > GARRAY_MAX_VALUE - position) {
+        perror("garray_set_range(): posible overflow of the garray_index type\n");
+        abort();
+    }
+
+    if (a->dense && position > a->num_elements) {
+        perror("garray_set_range(): position past the end of a dense array\n");
+        abort();
+    }
+
+    /* A page at a time */
+    if (a->paged) {
+        const int8_t* from = data;
+
+        while (n > 0) {
+            int8_t* page = touch_page(a, position);
+            garray_index run = PAGE_ELEMENTS - page_offset(position);
+
+            if (run > n)
+                run = n;
+
+            memcpy(page_element(a, page, position), from, (size_t)run * a->element_size);
+            a->num_elements += mark_bits(page_bitmap(a, page), page_offset(position), page_offset(position) + run,
+                                         true);
+
+            position += run;
+            from += (size_t)run * a->element_size;
+            n -= run;
+        }
+
+        return;
+    }
+
+    grow(a, position + n);
+
+    copy_to(a, position, data, n);
+
+    if (a->dense) {
+        if (position + n > a->num_elements)
+            a->num_elements = a->next_free = position + n;
+
+        return;
+    }
+
+    a->num_elements += mark_range(a, position, position + n, true);
+}
+
+void
+___garray_remove_range(garray a, garray_index position, garray_index n)
+{
+    const garray_index capacity = a->dense ? a->num_elements : index_end(a);
+
+    if (position >= capacity)
+        return;
+
+    garray_index end = n > capacity - position ? capacity : position + n, removed = 0;
+
+    /* As many elements as were removed, or all after the range if there are less, fill the gap from the end */
+    if (a->dense) {
+        garray_index moved = end - position < capacity - end ? end - position : capacity - end;
+
+        memcpy(get_element(a, position), get_element(a, capacity - moved), (size_t)moved * a->element_size);
+        a->num_elements = a->next_free = capacity - (end - position);
+
+        return;
+    }
+
+    /* Only the pages with something setted in the range are visited */
+    if (a->paged) {
+        for (garray_index from = paged_next_setted(a, position, end); from < end;
+             from = paged_next_setted(a, from, end)) {
+            garray_index run = PAGE_ELEMENTS - page_offset(from);
+
+            if (run > end - from)
+                run = end - from;
+
+            removed += mark_bits(page_bitmap(a, own_page(a, from, false)), page_offset(from),
+                                 page_offset(from) + run, false);
+            release_page_if_empty(a, from);
+            from += run;
+        }
+    } else
+        removed = mark_range(a, position, end, false);
+
+    a->num_elements -= removed;
+
+    if (position < a->next_free)
+        a->next_free = position;
+
+    if (a->compaction != NULL && removed > 0)
+        auto_compact(a, removed);
+}
+
+void
+___garray_at_many(garray a, const garray_index* positions, garray_index n, void* out)
+{
+    const garray_index capacity = index_end(a);
+    const size_t element_size = a->element_size;
+    int8_t* to = out;
+
+    for (garray_index i = 0; i < n; i++) {
+        garray_index position = positions[i];
+
+        if (position >= capacity) {
+            perror("garray_at_many(): position out of bounds\n");
+            abort();
+        }
+
+        if (!IS_SETTED(a, position)) {
+            perror("garray_at_many(): position not setted\n");
+            abort();
+        }
+
+        /* Constant sizes let the compiler turn memcpy into a single move */
+        switch (element_size) {
+        case 4:
+            memcpy(to, element(a, position), 4);
+            break;
+        case 8:
+            memcpy(to, element(a, position), 8);
+            break;
+        default:
+            memcpy(to, element(a, position), element_size);
+        }
+
+        to += element_size;
+    }
+}
+
+garray_index
+___garray_size(garray a)
+{
+    return __atomic_load_n(&a->num_elements, __ATOMIC_RELAXED);
+}
+
+garray
+___garray_clone(garray a)
+{
+    garray new_a = new_like(a);
+
+    if (a->paged)
+        paged_clone(a, new_a);
+
+    if (a->array == NULL)
+        return new_a;
+
+    /* The block holds the data and every bitmap, copying it copies the whole array but the segments */
+    const size_t size = block_size(block_data(a), a->bytes_allocated_values_setted);
+
+    new_a->array = size <= GARRAY_INLINE_BYTES ? (array_t)new_a->inline_block :
+                   allocate(new_a, size, "___garray_clone(): malloc\n");
+    memcpy(new_a->array, a->array, size);
+
+    new_a->capacity = a->capacity;
+    new_a->bytes_allocated_values_setted = a->bytes_allocated_values_setted;
+    new_a->num_elements = a->num_elements;
+    new_a->next_free = a->next_free;
+
+    if (a->segmented) {
+        add_segments(new_a, 0, get_capacity(a));
+
+        for (garray_index segment = 0; segment < num_segments(get_capacity(a)); segment++)
+            memcpy(new_a->segments[segment], a->segments[segment], (size_t)segment_length(segment) * a->element_size);
+    }
+
+    locate_bitmaps(new_a);
+
+    return new_a;
+}
+
+/*
+ * Compress kernels copy the elements whose bit is setted in a word of values_setted from the 64 elements
+ * at from to to, in order, and return how many they copied. The vector kernels store whole vectors, so
+ * to has to be at or before from in the same block, where the lanes past the copied elements only land
+ * on elements already read, or have room for 16 elements more than are copied. The portable kernels only
+ * read the setted elements and write the copied ones, so they also work on a last word of less than 64
+ * elements. With GARRAY_SIMD, on x86-64 AVX-512 or AVX2 kernels are picked at run time
+ */
+#ifndef GARRAY_SIMD
+#define GARRAY_SIMD 1
+#endif
+
+typedef garray_index (*compress_kernel)(int8_t* to, const int8_t* from, garray_word bits);
+
+static garray_index
+compress_4(int8_t* to, const int8_t* from, garray_word bits)
+{
+    garray_index n = 0;
+
+    for (; bits != 0; bits &= bits - 1) {
+        uint32_t element;
+
+        memcpy(&element, from + GARRAY_CTZ(bits) * sizeof(element), sizeof(element));
+        memcpy(to + n++ * sizeof(element), &element, sizeof(element));
+    }
+
+    return n;
+}
+
+static garray_index
+compress_8(int8_t* to, const int8_t* from, garray_word bits)
+{
+    garray_index n = 0;
+
+    for (; bits != 0; bits &= bits - 1) {
+        uint64_t element;
+
+        memcpy(&element, from + GARRAY_CTZ(bits) * sizeof(element), sizeof(element));
+        memcpy(to + n++ * sizeof(element), &element, sizeof(element));
+    }
+
+    return n;
+}
+
+#define portable_kernel(element_size) ((element_size) == 4 ? compress_4 : compress_8)
+
+#if GARRAY_SIMD && defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("avx512f"))) static garray_index
+compress_4_avx512(int8_t* to, const int8_t* from, garray_word bits)
+{
+    garray_index n = 0;
+
+    for (int lane = 0; lane < GARRAY_WORD_BITS; lane += 16) {
+        __mmask16 mask = (__mmask16)(bits >> lane);
+
+        if (mask == 0)
+            continue;
+
+        _mm512_storeu_si512(to + n * 4, _mm512_maskz_compress_epi32(mask, _mm512_loadu_si512(from + lane * 4)));
+        n += POPCOUNT(mask);
+    }
+
+    return n;
+}
+
+__attribute__((target("avx512f"))) static garray_index
+compress_8_avx512(int8_t* to, const int8_t* from, garray_word bits)
+{
+    garray_index n = 0;
+
+    for (int lane = 0; lane < GARRAY_WORD_BITS; lane += 8) {
+        __mmask8 mask = (__mmask8)(bits >> lane);
+
+        if (mask == 0)
+            continue;
+
+        _mm512_storeu_si512(to + n * 8, _mm512_maskz_compress_epi64(mask, _mm512_loadu_si512(from + lane * 8)));
+        n += POPCOUNT(mask);
+    }
+
+    return n;
+}
+
+/* For every mask of 8 lanes, the indices of its setted lanes in order, a byte each, to permute 32 bit lanes */
+static uint64_t compress_permutations[256];
+static pthread_once_t compress_permutations_once = PTHREAD_ONCE_INIT;
+
+static void
+init_compress_permutations(void)
+{
+    for (unsigned mask = 0; mask < 256; mask++) {
+        uint64_t indices = 0;
+        unsigned n = 0;
+
+        for (unsigned lane = 0; lane < 8; lane++)
+            if (mask & (1u << lane))
+                indices |= (uint64_t)lane << (8 * n++);
+
+        compress_permutations[mask] = indices;
+    }
+}
+
+#define compress_permutation(mask) _mm256_cvtepu8_epi32(_mm_cvtsi64_si128((long long)compress_permutations[mask]))
+
+__attribute__((target("avx2"))) static garray_index
+compress_4_avx2(int8_t* to, const int8_t* from, garray_word bits)
+{
+    garray_index n = 0;
+
+    for (int lane = 0; lane < GARRAY_WORD_BITS; lane += 8) {
+        unsigned mask = (unsigned)(bits >> lane) & 0xFF;
+
+        if (mask == 0)
+            continue;
+
+        __m256i elements = _mm256_loadu_si256((const __m256i*)(from + lane * 4));
+
+        _mm256_storeu_si256((__m256i*)(to + n * 4), _mm256_permutevar8x32_epi32(elements, compress_permutation(mask)));
+        n += POPCOUNT(mask);
+    }
+
+    return n;
+}
+
+/* An 8 byte element is a pair of 32 bit lanes, every bit of the mask of 4 elements is doubled */
+__attribute__((target("avx2"))) static garray_index
+compress_8_avx2(int8_t* to, const int8_t* from, garray_word bits)
+{
+    garray_index n = 0;
+
+    for (int lane = 0; lane < GARRAY_WORD_BITS; lane += 4) {
+        unsigned mask = (unsigned)(bits >> lane) & 0xF;
+
+        if (mask == 0)
+            continue;
+
+        unsigned pairs = (mask & 1) * 3 | (mask & 2) * 6 | (mask & 4) * 12 | (mask & 8) * 24;
+        __m256i elements = _mm256_loadu_si256((const __m256i*)(from + lane * 8));
+
+        _mm256_storeu_si256((__m256i*)(to + n * 8), _mm256_permutevar8x32_epi32(elements, compress_permutation(pairs)));
+        n += POPCOUNT(mask);
+    }
+
+    return n;
+}
+#endif
+
+/* The fastest compress kernel for element_size that the CPU runs, NULL if there is none for that size */
+static compress_kernel
+compress_kernel_for(size_t element_size)
+{
+    if (element_size != 4 && element_size != 8)
+        return NULL;
+
+#if GARRAY_SIMD && defined(__x86_64__) && defined(__GNUC__)
+    if (__builtin_cpu_supports("avx512f"))
+        return element_size == 4 ? compress_4_avx512 : compress_8_avx512;
+
+    if (__builtin_cpu_supports("avx2")) {
+        pthread_once(&compress_permutations_once, init_compress_permutations);
+        return element_size == 4 ? compress_4_avx2 : compress_8_avx2;
+    }
+#endif
+
+    return portable_kernel(element_size);
+}
+
+/* A flat array, whose elements are all contiguous in a single block with a bitmap */
+#define is_flat(a) (!(a)->dense && !(a)->paged && !(a)->segmented)
+
+/*
+ * Stable compaction of a flat array a word of values_setted at a time: from the word of the first hole
+ * on, every word copies its setted elements right after those of the previous one with compress, and
+ * the bitmap is rewritten once at the end
+ */
+static void
+compress_array(garray a, compress_kernel compress)
+{
+    const garray_index capacity = get_capacity(a);
+    const garray_index first_word = next_unsetted(a, a->next_free, capacity) >> LOG_B2_ELEMENTS_PER_NODE;
+    const garray_index full_words = capacity >> LOG_B2_ELEMENTS_PER_NODE;
+    garray_index to = first_word << LOG_B2_ELEMENTS_PER_NODE, word;
+
+    for (word = first_word; word < full_words; word++)
+        to += compress(get_element(a, to), get_element(a, word << LOG_B2_ELEMENTS_PER_NODE), a->values_setted[word]);
+
+    if (word << LOG_B2_ELEMENTS_PER_NODE < capacity)
+        to += portable_kernel(a->element_size)(get_element(a, to), get_element(a, word << LOG_B2_ELEMENTS_PER_NODE),
+                                               a->values_setted[word]);
+
+    mark_range(a, first_word << LOG_B2_ELEMENTS_PER_NODE, to, true);
+    mark_range(a, to, capacity, false);
+    a->next_free = to;
+}
+
+/* Gives back the capacity past next_free, once no element is left at or past it */
+static void
+shrink(garray a)
+{
+    const garray_index previous_capacity = a->capacity;
+    const size_t previous_allocation_values = a->bytes_allocated_values_setted;
+
+    a->capacity = a->next_free < previous_capacity ? a->next_free + 1 : previous_capacity;
+
+    /* A segmented array keeps the segments that hold the elements, the capacity is always a whole segment */
+    if (a->segmented) {
+        a->capacity = FIRST_SEGMENT;
+
+        while (a->capacity <= a->next_free && a->capacity < previous_capacity)
+            a->capacity <<= 1;
+
+        remove_segments(a, previous_capacity, a->capacity);
+    }
+
+    a->bytes_allocated_values_setted = BITMAP_SIZE(a, get_capacity(a));
+
+    /* Every setted bit is in the words that are kept, move them down to the end of the shrunk data */
+    memmove(a->array + bitmap_offset(block_data(a)), a->values_setted, a->bytes_allocated_values_setted);
+
+    const size_t previous_size = block_size(a->segmented ? 0 : data_size(a, previous_capacity),
+                                            previous_allocation_values);
+    const size_t size = block_size(block_data(a), a->bytes_allocated_values_setted);
+
+    /* A block that fits in the header goes back to it, unless it is kept in a file */
+    if (!is_inline(a)) {
+        if (size <= GARRAY_INLINE_BYTES && !is_shared_file(a)) {
+            memcpy(a->inline_block, a->array, size);
+            release_block(a, previous_size);
+            a->array = (array_t)a->inline_block;
+        } else
+            resize_block(a, previous_size, size, "___garray_collapse(): realloc\n");
+    }
+
+    resize_summary(a);
+}
+
+void
+___garray_collapse(garray a)
+{
+    if (a->paged) {
+        paged_collapse(a);
+        compaction_done(a);
+        return;
+    }
+
+    /* A dense array has no holes to remove */
+    if (a->array == NULL || a->dense)
+        return;
+
+    const garray_index capacity = get_capacity(a);
+    garray_index head = 0, tail = capacity;
+
+    /*
+     * Compressing copies every element after the first hole at memory speed and moving the last elements
+     * into the holes only copies as many as there are holes but finds each of them with a bit scan, so
+     * compressing is faster once there is a hole in 32 elements. It also keeps the order of the elements
+     */
+    compress_kernel compress = is_flat(a) ? compress_kernel_for(a->element_size) : NULL;
+    garray_index last = 0;
+
+    if (compress != NULL) {
+        head = next_unsetted(a, a->next_free, capacity);
+
+        if (!previous_setted(a, capacity - 1, &last) || last < head ||
+            last + 1 - a->num_elements >= (last + 1 - head) / 32) {
+            compress_array(a, compress);
+            compaction_done(a);
+            shrink(a);
+            return;
+        }
+    }
+
+    /* Move the last setted element into the first hole until every hole is after every setted element */
+    for (;;) {
+        head = next_unsetted(a, head, capacity);
+
+        if (tail == 0 || !previous_setted(a, tail - 1, &tail) || tail < head)
+            break;
+
+        memcpy(get_element(a, head), get_element(a, tail), a->element_size);
+
+        GARRAY_UNSET_VALUE_SETTED(a, tail);
+        GARRAY_SET_VALUE_SETTED(a, head);
+    }
+
+    a->next_free = head;
+    compaction_done(a);
+    shrink(a);
+}
+
+/*
+ * Stable version of ___garray_collapse(): the elements keep their order, whole spans are moved down at
+ * a time, and the array is shrunk the same way
+ */
+void
+___garray_compact(garray a)
+{
+    if (a->dense || (a->array == NULL && !a->paged))
+        return;
+
+    compaction_done(a);
+
+    if (a->paged) {
+        compact_step(a, GARRAY_MAX_VALUE);
+        return;
+    }
+
+    if (is_flat(a) && compress_kernel_for(a->element_size) != NULL) {
+        compress_array(a, compress_kernel_for(a->element_size));
+        shrink(a);
+        return;
+    }
+
+    /* A write and a read cursor through the spans, the bitmap is only rewritten once at the end */
+    const garray_index capacity = get_capacity(a);
+    const garray_index first_hole = next_unsetted(a, a->next_free, capacity);
+    garray_index to = first_hole;
+
+    for (garray_index from = next_setted(a, to, capacity); from < capacity; from = next_setted(a, from, capacity)) {
+        garray_index run = span_end(a, from, capacity) - from;
+
+        if (run > run_at(a, to))
+            run = run_at(a, to);
+
+        memmove(get_element(a, to), get_element(a, from), (size_t)run * a->element_size);
+        to += run;
+        from += run;
+    }
+
+    mark_range(a, first_hole, to, true);
+    mark_range(a, to, capacity, false);
+    a->next_free = to;
+    shrink(a);
+}
+
+bool
+___garray_compact_step(garray a, garray_index max_elements)
+{
+    if (a->dense || (a->array == NULL && !a->paged))
+        return true;
+
+    return compact_step(a, max_elements);
+}
+
+void
+___garray_set_auto_compaction(garray a, double max_hole_ratio, garray_index step_elements)
+{
+    /* Dense arrays have no holes and concurrent ones can not move their elements */
+    if (max_hole_ratio <= 0 || step_elements == 0 || a->dense || a->concurrent != NULL) {
+        deallocate(a, a->compaction, sizeof(struct garray_compaction));
+        a->compaction = NULL;
+        return;
+    }
+
+    if (a->compaction == NULL) {
+        a->compaction = allocate(a, sizeof(struct garray_compaction), "garray_set_auto_compaction(): malloc\n");
+        a->compaction->holes = 0;
+        a->compaction->running = false;
+    }
+
+    a->compaction->max_hole_ratio = max_hole_ratio;
+    a->compaction->step_elements = step_elements;
+}
+
+/*
+ * Collapses a and returns its elements as a contiguous array of num_elements elements: its own data or,
+ * for a paged or segmented array, a copy to be written back by unflatten()
+ */
+static int8_t*
+flatten(garray a)
+{
+    ___garray_collapse(a);
+
+    if (!a->paged && !a->segmented)
+        return a->array;
+
+    int8_t* elements = malloc((size_t)a->num_elements * a->element_size + 1);
+
+    if (elements == NULL) {
+        perror("flatten(): malloc\n");
+        abort();
+    }
+
+    for (garray_index position = 0, run; position < a->num_elements; position += run) {
+        run = run_at(a, position) < a->num_elements - position ? run_at(a, position) : a->num_elements - position;
+
+        memcpy(elements + (size_t)position * a->element_size, element(a, position), (size_t)run * a->element_size);
+    }
+
+    return elements;
+}
+
+/* Writes back the elements returned by flatten() once they have been reordered */
+static void
+unflatten(garray a, int8_t* elements)
+{
+    if (elements == a->array)
+        return;
+
+    for (garray_index position = 0, run; position < a->num_elements; position += run) {
+        run = run_at(a, position) < a->num_elements - position ? run_at(a, position) : a->num_elements - position;
+
+        int8_t* to = a->paged ? page_element(a, own_page(a, position, false), position) : get_element(a, position);
+
+        memcpy(to, elements + (size_t)position * a->element_size, (size_t)run * a->element_size);
+    }
+
+    free(elements);
+}
+
+void*
+___garray_flatten(garray a)
+{
+    return flatten(a);
+}
+
+void
+___garray_unflatten(garray a, void* elements)
+{
+    unflatten(a, elements);
+}
+
+garray
+___garray_sort(garray a, int criteria(void const*, void const*))
+{
+    a = ___garray_clone(a);
+
+    int8_t* elements = flatten(a);
+
+    qsort(elements, a->num_elements, a->element_size, criteria);
+    unflatten(a, elements);
+
+    return a;
+}
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+/*
+ * Stable LSD radix sort of keys[0, n), payload_size bytes of payload are moved along with each key
+ * (payload_size may be 0). keys_out and payload_out are scratch space of the same size as keys and
+ * payload. Only the lower key_bits bits of the keys are considered. Returns true if the sorted keys
+ * and payload ended up in keys_out and payload_out.
+ */
+static bool
+radix_sort(uint64_t* keys, int8_t* payload, uint64_t* keys_out, int8_t* payload_out,
+           size_t payload_size, garray_index n, unsigned key_bits)
+{
+    const unsigned passes = key_bits / RADIX_BITS;
+    garray_index histogram[sizeof(uint64_t)][RADIX_BUCKETS] = { { 0 } };
+    bool swapped = false;
+
+    if (n < 2)
+        return false;
+
+    /* Every histogram in a single read of the keys */
+    for (garray_index i = 0; i < n; i++)
+        for (unsigned pass = 0; pass < passes; pass++)
+            histogram[pass][(keys[i] >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+
+    for (unsigned pass = 0; pass < passes; pass++) {
+        const unsigned shift = pass * RADIX_BITS;
+        garray_index* count = histogram[pass];
+
+        /* Every key has the same digit, the pass would not move anything */
+        if (count[(keys[0] >> shift) & (RADIX_BUCKETS - 1)] == n)
+            continue;
+
+        for (garray_index bucket = 0, offset = 0; bucket < RADIX_BUCKETS; bucket++) {
+            garray_index bucket_size = count[bucket];
+            count[bucket] = offset;
+            offset += bucket_size;
+        }
+
+        for (garray_index i = 0; i < n; i++) {
+            garray_index to = count[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+
+            keys_out[to] = keys[i];
+
+            switch (payload_size) {
+            case 0:
+                break;
+            case sizeof(uint32_t):
+                ((uint32_t*)payload_out)[to] = ((uint32_t*)payload)[i];
+                break;
+            case sizeof(uint64_t):
+                ((uint64_t*)payload_out)[to] = ((uint64_t*)payload)[i];
+                break;
+            default:
+                memcpy(payload_out + (size_t)to * payload_size, payload + (size_t)i * payload_size,
+                       payload_size);
+            }
+        }
+
+        uint64_t* keys_tmp = keys;
+        keys = keys_out;
+        keys_out = keys_tmp;
+
+        int8_t* payload_tmp = payload;
+        payload = payload_out;
+        payload_out = payload_tmp;
+
+        swapped = !swapped;
+    }
+
+    return swapped;
+}
+
+/*
+ * Sorts the collapsed array a by keys[i], the key of the element i. keys is the start of a scratch
+ * buffer allocated by radix_prepare().
+ *
+ * If the keys are the elements themselves only the keys are sorted and then mapped back to
+ * elements with key_to_element. Elements of 4 or 8 bytes are moved with their keys, bigger ones
+ * are only moved once at the end: the keys are sorted along with the index of their element.
+ */
+static void
+radix_sort_collapsed(garray a, int8_t* elements, uint64_t* keys, unsigned key_bits,
+                     void key_to_element(uint64_t key, void* element))
+{
+    const garray_index n = a->num_elements;
+    const size_t element_size = a->element_size;
+    uint64_t* keys_out = keys + n;
+    int8_t* scratch = (int8_t*)(keys + 2 * (size_t)n);
+
+    if (key_to_element != NULL) {
+        if (radix_sort(keys, NULL, keys_out, NULL, 0, n, key_bits))
+            keys = keys_out;
+
+        for (garray_index i = 0; i < n; i++)
+            key_to_element(keys[i], elements + (size_t)i * element_size);
+    } else if (element_size == sizeof(uint32_t) || element_size == sizeof(uint64_t)) {
+        if (radix_sort(keys, elements, keys_out, scratch, element_size, n, key_bits))
+            memcpy(elements, scratch, (size_t)n * element_size);
+    } else {
+        garray_index* indexes = (garray_index*)scratch;
+        garray_index* indexes_out = indexes + n;
+        int8_t* elements_out = (int8_t*)(indexes_out + n);
+
+        for (garray_index i = 0; i < n; i++)
+            indexes[i] = i;
+
+        if (radix_sort(keys, (int8_t*)indexes, keys_out, (int8_t*)indexes_out, sizeof(garray_index), n,
+                       key_bits))
+            indexes = indexes_out;
+
+        for (garray_index i = 0; i < n; i++)
+            memcpy(elements_out + (size_t)i * element_size, elements + (size_t)indexes[i] * element_size,
+                   element_size);
+
+        memcpy(elements, elements_out, (size_t)n * element_size);
+    }
+}
+
+/*
+ * Clones and collapses a, returns the clone, in *elements its elements from flatten() and in *scratch
+ * the buffer radix_sort_collapsed() needs
+ */
+static garray
+radix_prepare(garray a, int8_t** elements, uint64_t** scratch)
+{
+    a = ___garray_clone(a);
+    *elements = flatten(a);
+
+    const size_t n = a->num_elements;
+    size_t scratch_size = 2 * n * sizeof(uint64_t);
+
+    if (a->element_size == sizeof(uint32_t) || a->element_size == sizeof(uint64_t))
+        scratch_size += n * a->element_size;
+    else
+        scratch_size += 2 * n * sizeof(garray_index) + n * a->element_size;
+
+    if ((*scratch = malloc(scratch_size + 1)) == NULL) {
+        perror("___garray_sort_radix(): malloc\n");
+        abort();
+    }
+
+    return a;
+}
+
+/* Inverse of the key functions of garray.h, used when the keys are the elements themselves */
+static void
+key_to_u32(uint64_t key, void* element)
+{
+    uint32_t value = (uint32_t)key;
+    memcpy(element, &value, sizeof(value));
+}
+
+static void
+key_to_i32(uint64_t key, void* element)
+{
+    key_to_u32(key ^ 0x80000000u, element);
+}
+
+static void
+key_to_f32(uint64_t key, void* element)
+{
+    key_to_u32(key & 0x80000000u ? key & ~(uint64_t)0x80000000u : ~key, element);
+}
+
+static void
+key_to_u64(uint64_t key, void* element)
+{
+    memcpy(element, &key, sizeof(key));
+}
+
+static void
+key_to_i64(uint64_t key, void* element)
+{
+    key_to_u64(key ^ ((uint64_t)1 << 63), element);
+}
+
+static void
+key_to_f64(uint64_t key, void* element)
+{
+    key_to_u64(key & ((uint64_t)1 << 63) ? key & ~((uint64_t)1 << 63) : ~key, element);
+}
+
+garray
+___garray_sort_radix(garray a, enum garray_radix_key key, size_t key_offset)
+{
+    static void (*const keys_to_elements[])(uint64_t, void*) = {
+        [GARRAY_RADIX_U32] = key_to_u32, [GARRAY_RADIX_I32] = key_to_i32,
+        [GARRAY_RADIX_F32] = key_to_f32, [GARRAY_RADIX_U64] = key_to_u64,
+        [GARRAY_RADIX_I64] = key_to_i64, [GARRAY_RADIX_F64] = key_to_f64,
+    };
+    const size_t key_size = key == GARRAY_RADIX_U32 || key == GARRAY_RADIX_I32 || key == GARRAY_RADIX_F32 ?
+                            sizeof(uint32_t) : sizeof(uint64_t);
+
+    if (key_offset + key_size > a->element_size) {
+        perror("___garray_sort_radix(): the key is outside of the element\n");
+        abort();
+    }
+
+    int8_t* elements;
+    uint64_t* keys;
+    a = radix_prepare(a, &elements, &keys);
+
+    for (garray_index i = 0; i < a->num_elements; i++) {
+        const int8_t* field = elements + (size_t)i * a->element_size + key_offset;
+
+        switch (key) {
+        case GARRAY_RADIX_U32: {
+            uint32_t value;
+            memcpy(&value, field, sizeof(value));
+            keys[i] = value;
+            break;
+        }
+        case GARRAY_RADIX_I32: {
+            int32_t value;
+            memcpy(&value, field, sizeof(value));
+            keys[i] = garray_radix_key_i32(value);
+            break;
+        }
+        case GARRAY_RADIX_F32: {
+            float value;
+            memcpy(&value, field, sizeof(value));
+            keys[i] = garray_radix_key_f32(value);
+            break;
+        }
+        case GARRAY_RADIX_U64: {
+            uint64_t value;
+            memcpy(&value, field, sizeof(value));
+            keys[i] = value;
+            break;
+        }
+        case GARRAY_RADIX_I64: {
+            int64_t value;
+            memcpy(&value, field, sizeof(value));
+            keys[i] = garray_radix_key_i64(value);
+            break;
+        }
+        case GARRAY_RADIX_F64: {
+            double value;
+            memcpy(&value, field, sizeof(value));
+            keys[i] = garray_radix_key_f64(value);
+            break;
+        }
+        }
+    }
+
+    radix_sort_collapsed(a, elements, keys, key_size * CHAR_BIT,
+                         key_size == a->element_size ? keys_to_elements[key] : NULL);
+    unflatten(a, elements);
+    free(keys);
+
+    return a;
+}
+
+garray
+___garray_sort_radix_by(garray a, uint64_t key(void const* element))
+{
+    int8_t* elements;
+    uint64_t* keys;
+    a = radix_prepare(a, &elements, &keys);
+
+    for (garray_index i = 0; i < a->num_elements; i++)
+        keys[i] = key(elements + (size_t)i * a->element_size);
+
+    radix_sort_collapsed(a, elements, keys, sizeof(uint64_t) * CHAR_BIT, NULL);
+    unflatten(a, elements);
+    free(keys);
+
+    return a;
+}
+
+/* Work of one thread of ___garray_sort_parallel(), either sorting a chunk or a piece of a merge */
+struct sort_task {
+    size_t element_size;
+    int (*criteria)(void const*, void const*);
+    void (*sort_chunk)(void*, size_t, int (*)(void const*, void const*));
+    int8_t* left;
+    size_t left_n;
+    int8_t* right;
+    size_t right_n;
+    int8_t* out;
+};
+
+static void*
+sort_chunk_task(void* arg)
+{
+    struct sort_task* task = arg;
+
+    task->sort_chunk(task->left, task->left_n, task->criteria);
+
+    return NULL;
+}
+
+/* Stable merge of left and right into out, on ties left goes first */
+static void*
+merge_task(void* arg)
+{
+    struct sort_task* task = arg;
+    const size_t element_size = task->element_size;
+    int8_t *left = task->left, *right = task->right, *out = task->out;
+    int8_t* const left_end = left + task->left_n * element_size;
+    int8_t* const right_end = right + task->right_n * element_size;
+
+    while (left < left_end && right < right_end) {
+        int8_t** from = task->criteria(right, left) < 0 ? &right : &left;
+
+        memcpy(out, *from, element_size);
+        *from += element_size;
+        out += element_size;
+    }
+
+    memcpy(out, left, left_end - left);
+    out += left_end - left;
+    memcpy(out, right, right_end - right);
+
+    return NULL;
+}
+
+/* Number of elements of left among the first diagonal elements of the stable merge of left and right */
+static size_t
+merge_split(struct sort_task* task, size_t diagonal)
+{
+    const size_t element_size = task->element_size;
+    size_t low = diagonal > task->right_n ? diagonal - task->right_n : 0;
+    size_t high = diagonal < task->left_n ? diagonal : task->left_n;
+
+    while (low < high) {
+        size_t i = low + (high - low) / 2;
+
+        if (task->criteria(task->left + i * element_size,
+                           task->right + (diagonal - i - 1) * element_size) <= 0)
+            low = i + 1;
+        else
+            high = i;
+    }
+
+    return low;
+}
+
+/* Runs task(tasks[i]) for every task, the last one on the calling thread */
+static void
+run_tasks(struct sort_task* tasks, size_t num_tasks, void* task(void*))
+{
+    pthread_t* threads = malloc(num_tasks * sizeof(pthread_t));
+
+    if (threads == NULL) {
+        perror("___garray_sort_parallel(): malloc\n");
+        abort();
+    }
+
+    for (size_t i = 0; i + 1 < num_tasks; i++) {
+        if (pthread_create(&threads[i], NULL, task, &tasks[i]) != 0) {
+            perror("___garray_sort_parallel(): pthread_create\n");
+            abort();
+        }
+    }
+
+    task(&tasks[num_tasks - 1]);
+
+    for (size_t i = 0; i + 1 < num_tasks; i++)
+        pthread_join(threads[i], NULL);
+
+    free(threads);
+}
+
+garray
+___garray_sort_parallel(garray a, int criteria(void const*, void const*), unsigned num_threads,
+                        void sort_chunk(void* base, size_t num_elements,
+                                        int criteria(void const*, void const*)))
+{
+    /* Below this many elements per thread, threads cost more than they save */
+#define PARALLEL_SORT_MIN_CHUNK 4096
+
+    a = ___garray_clone(a);
+
+    int8_t* const elements = flatten(a);
+    const size_t n = a->num_elements, element_size = a->element_size;
+
+    if (num_threads > n / PARALLEL_SORT_MIN_CHUNK)
+        num_threads = n / PARALLEL_SORT_MIN_CHUNK;
+
+    if (num_threads <= 1) {
+        sort_chunk(elements, n, criteria);
+        unflatten(a, elements);
+        return a;
+    }
+
+    struct sort_task* tasks = malloc(num_threads * sizeof(struct sort_task));
+    size_t* runs = malloc((num_threads + 1) * sizeof(size_t));
+    int8_t* out = malloc(n * element_size);
+
+    if (tasks == NULL || runs == NULL || out == NULL) {
+        perror("___garray_sort_parallel(): malloc\n");
+        abort();
+    }
+
+    /* runs[i] is the first element of the sorted run i */
+    for (unsigned i = 0; i <= num_threads; i++)
+        runs[i] = n * i / num_threads;
+
+    for (unsigned i = 0; i < num_threads; i++)
+        tasks[i] = (struct sort_task) { .element_size = element_size, .criteria = criteria,
+                                        .sort_chunk = sort_chunk,
+                                        .left = elements + runs[i] * element_size,
+                                        .left_n = runs[i + 1] - runs[i] };
+
+    run_tasks(tasks, num_threads, sort_chunk_task);
+
+    /* The runs go back and forth between the array and scratch, scratch is never owned by the array */
+    int8_t* const scratch = out;
+    int8_t* in = elements;
+
+    /* Merge pairs of runs until there is one, every merge split between num_threads / pairs threads */
+    for (size_t num_runs = num_threads; num_runs > 1; num_runs = (num_runs + 1) / 2) {
+        const size_t pairs = num_runs / 2;
+        const size_t threads_per_pair = num_threads / pairs;
+        size_t num_tasks = 0;
+
+        for (size_t pair = 0; pair < pairs; pair++) {
+            struct sort_task merge = { .element_size = element_size, .criteria = criteria };
+            const size_t start = runs[2 * pair], middle = runs[2 * pair + 1], end = runs[2 * pair + 2];
+
+            merge.left = in + start * element_size;
+            merge.left_n = middle - start;
+            merge.right = in + middle * element_size;
+            merge.right_n = end - middle;
+
+            for (size_t k = 0; k < threads_per_pair; k++) {
+                size_t first = (end - start) * k / threads_per_pair;
+                size_t last = (end - start) * (k + 1) / threads_per_pair;
+                size_t left_first = merge_split(&merge, first), left_last = merge_split(&merge, last);
+                struct sort_task* task = &tasks[num_tasks++];
+
+                *task = merge;
+                task->left = merge.left + left_first * element_size;
+                task->left_n = left_last - left_first;
+                task->right = merge.right + (first - left_first) * element_size;
+                task->right_n = (last - left_last) - (first - left_first);
+                task->out = out + (start + first) * element_size;
+            }
+        }
+
+        /* An odd run out is only copied */
+        if (num_runs % 2 == 1)
+            memcpy(out + runs[num_runs - 1] * element_size, in + runs[num_runs - 1] * element_size,
+                   (runs[num_runs] - runs[num_runs - 1]) * element_size);
+
+        run_tasks(tasks, num_tasks, merge_task);
+
+        for (size_t run = 0; 2 * run < num_runs; run++)
+            runs[run] = runs[2 * run];
+
+        runs[(num_runs + 1) / 2] = n;
+
+        int8_t* tmp = in;
+        in = out;
+        out = tmp;
+    }
+
+    if (in != elements)
+        memcpy(elements, in, n * element_size);
+
+    unflatten(a, elements);
+    free(scratch);
+    free(runs);
+    free(tasks);
+
+    return a;
+}
+
+void
+___garray_free(garray a)
+{
+    if (a->paged)
+        release_directory(a);
+
+    if (a->segmented) {
+        remove_segments(a, get_capacity(a), 0);
+        deallocate(a, a->segments, MAX_SEGMENTS * sizeof(int8_t*));
+    }
+
+    release_block(a, block_size(block_data(a), a->bytes_allocated_values_setted));
+
+    if (a->concurrent != NULL)
+        concurrent_free(a);
+
+    deallocate(a, a->compaction, sizeof(struct garray_compaction));
+    a->allocator->deallocate(a->allocator->context, a, sizeof(struct generic_array));
+}
+
+bool
+garray_save(garray a, const char* path)
+{
+    if (a->paged) {
+        errno = EINVAL;
+        return false;
+    }
+
+    FILE* file = fopen(path, "wb");
+
+    if (file == NULL)
+        return false;
+
+    static const int8_t zeros[FILE_HEADER_SIZE] = { 0 };
+    const struct file_header header = file_header(a);
+    const size_t data = data_size(a, header.capacity);
+    const size_t bitmaps = block_size(0, a->bytes_allocated_values_setted);
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(zeros, 1, FILE_HEADER_SIZE - sizeof(header), file) == FILE_HEADER_SIZE - sizeof(header);
+
+    /* The segments of a segmented array are written one after the other, as the data of a flat one */
+    for (garray_index position = 0, run; written && position < header.capacity; position += run) {
+        run = contiguous_run(a, position) < header.capacity - position ? contiguous_run(a, position) :
+              (garray_index)header.capacity - position;
+
+        written = fwrite(get_element(a, position), a->element_size, run, file) == run;
+    }
+
+    /* values_setted and the summary are contiguous and start at the first word boundary after the data */
+    if (written && bitmaps > 0)
+        written = fwrite(zeros, 1, bitmap_offset(data) - data, file) == bitmap_offset(data) - data &&
+                  fwrite(a->values_setted, bitmaps, 1, file) == 1;
+
+    if (fclose(file) != 0)
+        written = false;
+
+    return written;
+}
+
+#ifdef __linux__
+/* Whether header describes a block of block_size bytes of an array of elements of element_size bytes */
+static bool
+valid_header(const struct file_header* header, size_t element_size, size_t block_size_in_file)
+{
+    if (memcmp(header->magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 || header->version != FILE_VERSION ||
+        header->byte_order != FILE_BYTE_ORDER || header->element_size != element_size)
+        return false;
+
+    /* The sizes must fit in this build before computing anything with them */
+    if (header->capacity > GARRAY_MAX_VALUE || header->capacity > SIZE_MAX / (element_size + 1) ||
+        header->num_elements > header->capacity || header->next_free > header->capacity)
+        return false;
+
+    const size_t values_setted = header->dense ? 0 : VALUES_SETTED_SIZE(header->capacity);
+
+    return header->bytes_values_setted == values_setted &&
+           block_size(header->capacity * element_size, values_setted) == block_size_in_file;
+}
+#endif
+
+garray
+___garray_open_mmap(const char* path, garray_index element_size, enum garray_map_mode mode)
+{
+#ifdef __linux__
+    const int fd = open(path, mode == GARRAY_MAP_SHARED ? O_RDWR : O_RDONLY);
+    struct stat file_stat;
+
+    if (fd < 0)
+        return NULL;
+
+    if (fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < FILE_HEADER_SIZE) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    const size_t length = (size_t)file_stat.st_size;
+    int8_t* mapping = mmap(NULL, length, mode == GARRAY_MAP_READONLY ? PROT_READ : PROT_READ | PROT_WRITE,
+                           mode == GARRAY_MAP_PRIVATE ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+
+    if (mapping == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+
+    struct file_header header;
+
+    memcpy(&header, mapping, sizeof(header));
+
+    if (!valid_header(&header, element_size, length - FILE_HEADER_SIZE)) {
+        munmap(mapping, length);
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    garray a = new_array(element_size, NULL, header.dense ? STORAGE_DENSE : STORAGE_FLAT);
+
+    a->file = allocate(a, sizeof(struct garray_file), "___garray_open_mmap(): malloc\n");
+    *a->file = (struct garray_file) { .mode = mode, .fd = fd, .mapping = mapping, .length = length };
+
+    if (mode != GARRAY_MAP_SHARED) {
+        close(fd);
+        a->file->fd = -1;
+    }
+
+    /* The block is used where it is, the summary too */
+    a->array = mapping + FILE_HEADER_SIZE;
+    a->capacity = (garray_index)header.capacity;
+    a->bytes_allocated_values_setted = header.bytes_values_setted;
+    a->num_elements = (garray_index)header.num_elements;
+    a->next_free = (garray_index)header.next_free;
+    locate_bitmaps(a);
+
+    return a;
+#else
+    (void)path;
+    (void)element_size;
+    (void)mode;
+    errno = ENOSYS;
+    return NULL;
+#endif
+}
+
+garray_iter
+___garray_iter_init(garray a, garray_iter iterator)
+{
+    const garray_index end = index_end(a);
+
+    iterator->garray = a;
+    iterator->index = next_setted(a, 0, end);
+    iterator->valid_index = iterator->index < end;
+
+    return iterator;
+}
+
+garray_iter
+___garray_iter_new(garray a)
+{
+    garray_iter new_iter = allocate(a, sizeof(struct generic_array_iterator), "___garray_iter_new(): malloc\n");
+
+    return ___garray_iter_init(a, new_iter);
+}
+
+bool
+___garray_iter_condition(garray_iter iterator)
+{
+    return iterator->valid_index;
+}
+
+#define fast_condition(iter) iter->valid_index
+
+void
+___garray_iter_free(garray_iter iterator)
+{
+    deallocate(iterator->garray, iterator, sizeof(struct generic_array_iterator));
+}
+
+bool
+___garray_iter_condition_free(garray_iter iterator)
+{
+    if (fast_condition(iterator))
+        return true;
+
+    ___garray_iter_free(iterator);
+    return false;
+}
+
+void
+___garray_iter_next(garray_iter iterator)
+{
+    const garray_index max_index = index_end(iterator->garray);
+
+    if (iterator->index >= max_index) {
+        iterator->valid_index = false;
+        return;
+    }
+
+    iterator->index = next_setted(iterator->garray, iterator->index + 1, max_index);
+    iterator->valid_index = iterator->index < max_index;
+}
+
+void
+___garray_iter_previous(garray_iter iterator)
+{
+    if (iterator->index == 0 || index_end(iterator->garray) == 0) {
+        iterator->valid_index = false;
+        return;
+    }
+
+    iterator->valid_index = previous_setted(iterator->garray, iterator->index - 1, &iterator->index);
+}
+
+void const*
+___garray_iter_get(garray_iter iterator)
+{
+    if (iterator->garray->paged)
+        return ___garray_at(iterator->garray, iterator->index);
+
+    return get_element(iterator->garray, iterator->index);
+}
+
+void
+___garray_iter_set(garray_iter iterator, void const* data)
+{
+    ___garray_set(iterator->garray, iterator->index, data);
+}
+
+garray_index
+___garray_iter_get_index(garray_iter iterator)
+{
+    return iterator->index;
+}
+
+bool
+___garray_iter_set_index(garray_iter iterator, garray_index index)
+{
+    if (index >= index_end(iterator->garray))
+        return false;
+
+    iterator->index = index;
+    iterator->valid_index = IS_SETTED(iterator->garray, index);
+
+    return true;
+}
+
+garray_index
+___garray_next_span(garray a, garray_index* position, void const** ptr)
+{
+    const garray_index capacity = index_end(a);
+    garray_index start = next_setted(a, *position, capacity);
+
+    if (start >= capacity)
+        return 0;
+
+    *position = start;
+    *ptr = element(a, start);
+
+    return span_end(a, start, capacity) - start;
+}
+
+/*
+ * Format of the streams of garray_write(): a header and then one record per span of setted elements, the
+ * number of unsetted positions before the span and its length as LEB128 varints followed by its elements.
+ * Holes cost a couple of bytes whatever their length, so only the setted elements are written. The
+ * records are read until num_elements elements have been read, a stream can be followed by anything else
+ */
+#define STREAM_MAGIC "GSTREAM"
+#define STREAM_VERSION 1
+
+/* Size of the buffer elements are read through, streams are never read whole */
+#define STREAM_CHUNK ((size_t)1 << 16)
+
+struct stream_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t storage; //The enum storage of the array, it is read back in the same mode
+    uint64_t byte_order;
+    uint64_t element_size;
+    uint64_t num_elements;
+    uint64_t end; //One past the last setted position, how much a flat array must grow
+};
+
+static bool
+write_varint(FILE* stream, uint64_t value)
+{
+    unsigned char bytes[10];
+    size_t length = 0;
+
+    do {
+        bytes[length++] = (unsigned char)(value & 0x7f) | (value > 0x7f ? 0x80 : 0);
+        value >>= 7;
+    } while (value > 0);
+
+    return fwrite(bytes, 1, length, stream) == length;
+}
+
+static bool
+read_varint(FILE* stream, uint64_t* value)
+{
+    *value = 0;
+
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        const int byte = getc(stream);
+
+        if (byte == EOF)
+            return false;
+
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+bool
+garray_write(garray a, FILE* stream)
+{
+    garray_index last = 0;
+    const bool not_empty = a->num_elements > 0 && previous_setted(a, index_end(a) - 1, &last);
+    const struct stream_header header = {
+        .magic = STREAM_MAGIC,
+        .version = STREAM_VERSION,
+        .storage = storage_of(a),
+        .byte_order = FILE_BYTE_ORDER,
+        .element_size = a->element_size,
+        .num_elements = a->num_elements,
+        .end = not_empty ? (uint64_t)last + 1 : 0,
+    };
+
+    if (fwrite(&header, sizeof(header), 1, stream) != 1)
+        return false;
+
+    /* Spans are written from where they are, stdio buffers the small ones */
+    void const* span;
+    garray_index written = 0;
+
+    for (garray_index position = 0, length; (length = ___garray_next_span(a, &position, &span)) != 0;
+         position += length) {
+        if (!write_varint(stream, position - written) || !write_varint(stream, length) ||
+            fwrite(span, a->element_size, length, stream) != length)
+            return false;
+
+        written = position + length;
+    }
+
+    return true;
+}
+
+/* Reads the records of a stream with header into a, through buffer of chunk elements */
+static bool
+read_records(garray a, FILE* stream, const struct stream_header* header, void* buffer, garray_index chunk)
+{
+    uint64_t position = 0, remaining = header->num_elements, gap, length;
+
+    while (remaining > 0) {
+        /* Spans must be in order, before the end of the header and, for a dense array, without holes */
+        if (!read_varint(stream, &gap) || !read_varint(stream, &length) || length == 0 || length > remaining ||
+            gap > header->end - position || length > header->end - position - gap || (a->dense && gap > 0))
+            return false;
+
+        position += gap;
+        remaining -= length;
+
+        while (length > 0) {
+            const garray_index n = length < chunk ? (garray_index)length : chunk;
+
+            if (fread(buffer, a->element_size, n, stream) != n)
+                return false;
+
+            ___garray_set_range(a, (garray_index)position, buffer, n);
+            position += n;
+            length -= n;
+        }
+    }
+
+    return true;
+}
+
+garray
+___garray_read(FILE* stream, garray_index element_size)
+{
+    struct stream_header header;
+
+    if (fread(&header, sizeof(header), 1, stream) != 1) {
+        if (!ferror(stream))
+            errno = EINVAL;
+
+        return NULL;
+    }
+
+    if (memcmp(header.magic, STREAM_MAGIC, sizeof(STREAM_MAGIC)) != 0 || header.version != STREAM_VERSION ||
+        header.byte_order != FILE_BYTE_ORDER || header.element_size != element_size ||
+        header.storage > STORAGE_CONCURRENT || header.num_elements > header.end || header.end > GARRAY_MAX_VALUE) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    garray a = new_array(element_size, NULL, (enum storage)header.storage);
+
+    if (!a->paged && header.end > max_capacity(a)) {
+        ___garray_free(a);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    /* Grows once up front, but a paged array, that only allocates the pages it is written */
+    if (!a->paged)
+        grow(a, (garray_index)header.end);
+
+    const garray_index chunk = STREAM_CHUNK / element_size > 0 ? STREAM_CHUNK / element_size : 1;
+    void* buffer = malloc((size_t)chunk * element_size);
+
+    if (buffer == NULL) {
+        perror("___garray_read(): malloc\n");
+        abort();
+    }
+
+    const bool read = read_records(a, stream, &header, buffer, chunk);
+
+    free(buffer);
+
+    if (!read) {
+        if (!ferror(stream))
+            errno = EINVAL;
+
+        ___garray_free(a);
+        return NULL;
+    }
+
+    return a;
+}
+
+bool
+___garray_contains(garray a, const void* value,
+                   bool comparator(void const* left, void const* right))
+{
+    struct garray_foreach it = ___garray_foreach_begin(a);
+
+    while (___garray_foreach_next(&it)) {
+        if (comparator(value, foreach_element(a, &it)))
+            return true;
+    }
+
+    return false;
+}
+
+/* Elements matched by ___garray_query() or by a chunk of ___garray_query_parallel() */
+struct scan_result {
+    int8_t* elements;
+    garray_index num_elements;
+    garray_index num_allocated;
+};
+
+/* Makes room in result for n elements more, and for the whole vectors the compress kernels store */
+static void
+reserve_result(struct scan_result* result, garray_index n, size_t element_size)
+{
+    if (result->num_allocated - result->num_elements >= n + 16)
+        return;
+
+    while (result->num_allocated - result->num_elements < n + 16)
+        result->num_allocated = result->num_allocated == 0 ? 64 : result->num_allocated << 1;
+
+    REALLOC(result->elements, (size_t)result->num_allocated * element_size, "___garray_query(): realloc\n");
+}
+
+/*
+ * Appends to result the setted elements of [start, end) that match condition, in order. In a flat array
+ * of 4 or 8 byte elements the matches of a word of values_setted are gathered in a bitmap and copied at
+ * once with a compress kernel, start is then the start of a word
+ */
+static void
+query_range(garray a, garray_index start, garray_index end, bool condition(void const* value, void* data),
+            void* data, struct scan_result* result)
+{
+    compress_kernel compress = is_flat(a) ? compress_kernel_for(a->element_size) : NULL;
+
+    if (compress == NULL) {
+        for (garray_index i = next_setted(a, start, end); i < end; i = next_setted(a, i + 1, end)) {
+            if (!condition(element(a, i), data))
+                continue;
+
+            reserve_result(result, 1, a->element_size);
+            memcpy(result->elements + (size_t)result->num_elements++ * a->element_size, element(a, i),
+                   a->element_size);
+        }
+
+        return;
+    }
+
+    for (garray_index first = start; first < end; first += ELEMENTS_PER_NODE) {
+        garray_word bits = a->values_setted[first >> LOG_B2_ELEMENTS_PER_NODE], matches = 0;
+
+        if (end - first < ELEMENTS_PER_NODE)
+            bits &= GARRAY_WORD_FULL >> (ELEMENTS_PER_NODE - (end - first));
+
+        for (; bits != 0; bits &= bits - 1)
+            if (condition(get_element(a, first + GARRAY_CTZ(bits)), data))
+                matches |= bits & -bits;
+
+        if (matches == 0)
+            continue;
+
+        /* The vector kernels read the whole word, the last one may be past the capacity */
+        compress_kernel kernel = get_capacity(a) - first < ELEMENTS_PER_NODE ? portable_kernel(a->element_size)
+                                                                               : compress;
+
+        reserve_result(result, ELEMENTS_PER_NODE, a->element_size);
+        result->num_elements += kernel(result->elements + (size_t)result->num_elements * a->element_size,
+                                       get_element(a, first), matches);
+    }
+}
+
+garray
+___garray_query(
+    garray a, void* data,
+    bool condition(void const* value, void* data))
+{
+    /* Matches are gathered in a buffer and added at once */
+    if (is_flat(a) && compress_kernel_for(a->element_size) != NULL) {
+        struct scan_result result = { NULL, 0, 0 };
+        garray new_a = new_like(a);
+
+        query_range(a, 0, get_capacity(a), condition, data, &result);
+        ___garray_add_many(new_a, result.elements, result.num_elements);
+        free(result.elements);
+
+        return new_a;
+    }
+
+    garray new_a = new_like(a);
+    struct garray_foreach it = ___garray_foreach_begin(a);
+    void const* current = NULL;
+
+    while (___garray_foreach_next(&it)) {
+        current = foreach_element(a, &it);
+
+        if (condition(current, data))
+            ___garray_add(new_a, current);
+    }
+
+    return new_a;
+}
+
+void const*
+___garray_get(garray a, void* data, bool condition(void const* value,
+                                                   void* data))
+{
+    struct garray_foreach it = ___garray_foreach_begin(a);
+    void const* current = NULL;
+
+    while (___garray_foreach_next(&it)) {
+        current = foreach_element(a, &it);
+
+        if (condition(current, data))
+            return current;
+    }
+
+    return NULL;
+}
+
+struct garray_pool {
+    pthread_mutex_t mutex;
+    pthread_cond_t work_ready; //Signaled when there is a new job or the pool is stopping
+    pthread_cond_t work_done; //Signaled when the last worker finishes the job
+    unsigned num_workers; //Threads of the pool, the thread that runs a job also works on it
+    pthread_t* workers;
+    void (*job)(void*);
+    void* job_arg;
+    unsigned long generation; //Incremented every time there is a new job
+    unsigned busy_workers;
+    bool stop;
+};
+
+static void*
+pool_worker(void* arg)
+{
+    garray_pool pool = arg;
+    unsigned long seen_generation = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    for (;;) {
+        while (pool->generation == seen_generation && !pool->stop)
+            pthread_cond_wait(&pool->work_ready, &pool->mutex);
+
+        if (pool->stop)
+            break;
+
+        seen_generation = pool->generation;
+
+        void (*job)(void*) = pool->job;
+        void* job_arg = pool->job_arg;
+
+        pthread_mutex_unlock(&pool->mutex);
+        job(job_arg);
+        pthread_mutex_lock(&pool->mutex);
+
+        if (--pool->busy_workers == 0)
+            pthread_cond_signal(&pool->work_done);
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+
     return NULL;
 }
+
+garray_pool
+garray_pool_new(unsigned num_threads)
+{
+    garray_pool pool = malloc(sizeof(struct garray_pool));
+
+    if (pool == NULL) {
+        perror("garray_pool_new(): malloc\n");
+        abort();
+    }
+
+    pool->num_workers = num_threads > 1 ? num_threads - 1 : 0;
+    pool->workers = malloc(pool->num_workers * sizeof(pthread_t) + 1);
+    pool->job = NULL;
+    pool->job_arg = NULL;
+    pool->generation = 0;
+    pool->busy_workers = 0;
+    pool->stop = false;
+
+    if (pool->workers == NULL) {
+        perror("garray_pool_new(): malloc\n");
+        abort();
+    }
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+
+    for (unsigned i = 0; i < pool->num_workers; i++) {
+        if (pthread_create(&pool->workers[i], NULL, pool_worker, pool) != 0) {
+            perror("garray_pool_new(): pthread_create\n");
+            abort();
+        }
+    }
+
+    return pool;
+}
+
+void
+garray_pool_free(garray_pool pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (unsigned i = 0; i < pool->num_workers; i++)
+        pthread_join(pool->workers[i], NULL);
+
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_cond_destroy(&pool->work_done);
+    free(pool->workers);
+    free(pool);
+}
+
+/* Runs job(job_arg) on every thread of the pool and on the calling one, returns when all finished */
+static void
+pool_run(garray_pool pool, void job(void*), void* job_arg)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->job = job;
+    pool->job_arg = job_arg;
+    pool->busy_workers = pool->num_workers;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->mutex);
+
+    job(job_arg);
+
+    pthread_mutex_lock(&pool->mutex);
+
+    while (pool->busy_workers > 0)
+        pthread_cond_wait(&pool->work_done, &pool->mutex);
+
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/*
+ * A parallel scan over the slots of an array. The slots are split in chunks of a whole number of
+ * words of values_setted, every thread claims the next chunk until there are no more.
+ */
+struct scan {
+    garray a;
+    garray_index chunk_size;
+    garray_index num_chunks;
+    atomic_size_t next_chunk;
+    void* data;
+    bool (*condition)(void const* value, void* data);
+    const void* value;
+    bool (*comparator)(void const* left, void const* right);
+    atomic_size_t found; //Lowest matching index found, SIZE_MAX if none
+    struct scan_result* results; //One per chunk, only for query
+};
+
+static void
+scan_init(struct scan* scan, garray a, garray_pool pool)
+{
+    const garray_index capacity = index_end(a);
+    /* Several chunks per thread so that threads that finish early take work from the slow ones */
+    garray_index chunk_size = capacity / ((pool->num_workers + 1) * 8) + 1;
+
+    chunk_size = (chunk_size + 4095) & ~(garray_index)4095;
+
+    scan->a = a;
+    scan->chunk_size = chunk_size;
+    scan->num_chunks = capacity / chunk_size + (capacity % chunk_size != 0);
+    atomic_init(&scan->next_chunk, 0);
+    atomic_init(&scan->found, SIZE_MAX);
+    scan->data = NULL;
+    scan->condition = NULL;
+    scan->value = NULL;
+    scan->comparator = NULL;
+    scan->results = NULL;
+}
+
+/* Claims the next chunk, returns false when there are no more */
+static bool
+scan_next_chunk(struct scan* scan, garray_index* chunk, garray_index* start, garray_index* end)
+{
+    size_t next = atomic_fetch_add(&scan->next_chunk, 1);
+
+    if (next >= scan->num_chunks)
+        return false;
+
+    const garray_index capacity = index_end(scan->a);
+
+    *chunk = next;
+    *start = next * scan->chunk_size;
+    *end = capacity - *start > scan->chunk_size ? *start + scan->chunk_size : capacity;
+
+    return true;
+}
+
+static void
+query_job(void* arg)
+{
+    struct scan* scan = arg;
+    garray a = scan->a;
+    garray_index chunk, start, end;
+
+    while (scan_next_chunk(scan, &chunk, &start, &end))
+        query_range(a, start, end, scan->condition, scan->data, &scan->results[chunk]);
+}
+
+garray
+___garray_query_parallel(garray a, void* data, bool condition(void const* value, void* data),
+                         garray_pool pool)
+{
+    struct scan scan;
+    garray_index total = 0;
+
+    scan_init(&scan, a, pool);
+    scan.data = data;
+    scan.condition = condition;
+    scan.results = calloc(scan.num_chunks + 1, sizeof(struct scan_result));
+
+    if (scan.results == NULL) {
+        perror("___garray_query_parallel(): calloc\n");
+        abort();
+    }
+
+    pool_run(pool, query_job, &scan);
+
+    for (garray_index chunk = 0; chunk < scan.num_chunks; chunk++)
+        total += scan.results[chunk].num_elements;
+
+    garray new_a = new_like(a);
+
+    if (total > 0 && !new_a->paged)
+        preallocate(new_a, total);
+
+    /* Concatenated in index order, the same order ___garray_query() adds them */
+    for (garray_index chunk = 0, position = 0; chunk < scan.num_chunks; chunk++) {
+        struct scan_result* result = &scan.results[chunk];
+
+        if (result->num_elements > 0 && new_a->paged)
+            ___garray_set_range(new_a, position, result->elements, result->num_elements);
+        else if (result->num_elements > 0)
+            copy_to(new_a, position, result->elements, result->num_elements);
+
+        position += result->num_elements;
+        free(result->elements);
+    }
+
+    free(scan.results);
+
+    if (total > 0 && !new_a->dense && !new_a->paged) {
+        memset(new_a->values_setted, 0xFF, (total >> LOG_B2_ELEMENTS_PER_NODE) * sizeof(garray_word));
+
+        if (total % ELEMENTS_PER_NODE != 0)
+            new_a->values_setted[total >> LOG_B2_ELEMENTS_PER_NODE] =
+                GARRAY_WORD_FULL >> (ELEMENTS_PER_NODE - total % ELEMENTS_PER_NODE);
+
+        resize_summary(new_a);
+    }
+
+    new_a->num_elements = total;
+    new_a->next_free = total;
+
+    return new_a;
+}
+
+static void
+get_job(void* arg)
+{
+    struct scan* scan = arg;
+    garray a = scan->a;
+    garray_index chunk, start, end;
+
+    while (scan_next_chunk(scan, &chunk, &start, &end)) {
+        for (garray_index i = next_setted(a, start, end); i < end; i = next_setted(a, i + 1, end)) {
+            size_t found = atomic_load_explicit(&scan->found, memory_order_relaxed);
+
+            /* Chunks are claimed in order, every chunk after this one is also after found */
+            if (found < i)
+                return;
+
+            if (!scan->condition(element(a, i), scan->data))
+                continue;
+
+            while (i < found && !atomic_compare_exchange_weak(&scan->found, &found, i))
+                ;
+
+            break;
+        }
+    }
+}
+
+void const*
+___garray_get_parallel(garray a, void* data, bool condition(void const* value, void* data),
+                       garray_pool pool)
+{
+    struct scan scan;
+
+    scan_init(&scan, a, pool);
+    scan.data = data;
+    scan.condition = condition;
+
+    pool_run(pool, get_job, &scan);
+
+    size_t found = atomic_load(&scan.found);
+
+    return found == SIZE_MAX ? NULL : element(a, found);
+}
+
+static void
+contains_job(void* arg)
+{
+    struct scan* scan = arg;
+    garray a = scan->a;
+    garray_index chunk, start, end;
+
+    while (scan_next_chunk(scan, &chunk, &start, &end)) {
+        for (garray_index i = next_setted(a, start, end); i < end; i = next_setted(a, i + 1, end)) {
+            if (atomic_load_explicit(&scan->found, memory_order_relaxed) != SIZE_MAX)
+                return;
+
+            if (scan->comparator(scan->value, element(a, i))) {
+                atomic_store(&scan->found, i);
+                return;
+            }
+        }
+    }
+}
+
+bool
+___garray_contains_parallel(garray a, const void* value,
+                            bool comparator(void const* left, void const* right), garray_pool pool)
+{
+    struct scan scan;
+
+    scan_init(&scan, a, pool);
+    scan.value = value;
+    scan.comparator = comparator;
+
+    pool_run(pool, contains_job, &scan);
+
+    return atomic_load(&scan.found) != SIZE_MAX;
+}
+
+/*
+ * A sharded array is a list of dense arrays, one per appending thread, so each add only writes memory of
+ * its own thread. Their headers are larger than two cache lines and start with the counters add writes,
+ * so two shards only share a line while one of them still fits in its header. The mutex is only taken to
+ * add a shard and to merge them.
+ */
+struct garray_sharded {
+    garray_index element_size;
+    pthread_mutex_t mutex;
+    garray* shards;
+    size_t num_shards;
+    size_t allocated_shards;
+};
+
+garray_sharded
+___garray_sharded_new(garray_index element_size)
+{
+    garray_sharded sharded = malloc(sizeof(struct garray_sharded));
+
+    if (sharded == NULL) {
+        perror("garray_sharded_new(): malloc\n");
+        abort();
+    }
+
+    sharded->element_size = element_size;
+    sharded->shards = NULL;
+    sharded->num_shards = 0;
+    sharded->allocated_shards = 0;
+    pthread_mutex_init(&sharded->mutex, NULL);
+
+    return sharded;
+}
+
+garray
+___garray_sharded_shard(garray_sharded sharded)
+{
+    /* Allocated by the calling thread, from its own malloc() arena */
+    garray shard = ___garray_new_dense(sharded->element_size, NULL);
+
+    pthread_mutex_lock(&sharded->mutex);
+
+    if (sharded->num_shards == sharded->allocated_shards) {
+        sharded->allocated_shards = sharded->allocated_shards == 0 ? 8 : sharded->allocated_shards * 2;
+        REALLOC(sharded->shards, sharded->allocated_shards * sizeof(garray), "garray_sharded_shard(): realloc\n");
+    }
+
+    sharded->shards[sharded->num_shards++] = shard;
+    pthread_mutex_unlock(&sharded->mutex);
+
+    return shard;
+}
+
+garray
+___garray_sharded_merge(garray_sharded sharded, bool empty_shards)
+{
+    pthread_mutex_lock(&sharded->mutex);
+
+    garray_index num_elements = 0;
+
+    for (size_t shard = 0; shard < sharded->num_shards; shard++) {
+        if (sharded->shards[shard]->num_elements > GARRAY_MAX_VALUE - num_elements) {
+            perror("garray_sharded_merge(): posible overflow of the garray_index type\n");
+            abort();
+        }
+
+        num_elements += sharded->shards[shard]->num_elements;
+    }
+
+    /* Allocated once, every shard is a single span copied whole */
+    garray merged = ___garray_new_preallocated(num_elements, sharded->element_size);
+
+    for (size_t shard = 0; shard < sharded->num_shards; shard++) {
+        garray a = sharded->shards[shard];
+
+        if (a->num_elements == 0)
+            continue;
+
+        ___garray_add_many(merged, get_element(a, 0), a->num_elements);
+
+        /* The shard keeps its capacity for the next appends */
+        if (empty_shards)
+            ___garray_remove_range(a, 0, a->num_elements);
+    }
+
+    pthread_mutex_unlock(&sharded->mutex);
+
+    return merged;
+}
+
+void
+garray_sharded_free(garray_sharded sharded)
+{
+    for (size_t shard = 0; shard < sharded->num_shards; shard++)
+        ___garray_free(sharded->shards[shard]);
+
+    pthread_mutex_destroy(&sharded->mutex);
+    free(sharded->shards);
+    free(sharded);
+}
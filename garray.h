@@ -13,9 +13,16 @@
 // Type used to index the values of the array
 //
 // The number of elements in the array can not surpass the maximun value of this
-// type.
+// type. Defining GARRAY_INDEX_64 before including garray.h, in every module,
+// makes it 64 bits wide for arrays of more than 4G elements. Sizes in bytes are
+// always size_t, so only the number of elements is limited by this type.
+#ifdef GARRAY_INDEX_64
+typedef uint64_t garray_index;
+#define GARRAY_MAX_VALUE UINT64_MAX
+#else
 typedef unsigned int garray_index;
 #define GARRAY_MAX_VALUE UINT_MAX
+#endif
 
 /*
  *  Generic Array library
@@ -63,6 +70,81 @@ typedef unsigned int garray_index;
  * garray_TYPE garray_TYPE_new_preallocated(garray_index
  * num_elements_preallocated)
  *
+ * Same as garray_TYPE_new() but every allocation of the array, its iterators
+ * and the arrays returned by garray_TYPE_clone(), garray_TYPE_query() and the
+ * sorts goes through allocator. NULL uses the default allocator, see
+ * garray_set_default_allocator()
+ * garray_TYPE garray_TYPE_new_with_allocator(
+ *                          struct garray_allocator const *allocator);
+ *
+ * Returns an empty dense array: it never has holes, its elements are always
+ * the positions [0, garray_TYPE_size(a)) and no values_setted is allocated.
+ * garray_TYPE_remove() moves the last element into the removed position, so
+ * removing changes the order, garray_TYPE_set() can only overwrite an element
+ * or append right after the last one and garray_TYPE_collapse() does nothing
+ * garray_TYPE garray_TYPE_new_dense();
+ *
+ * Returns an empty paged array, for sparse arrays indexed by big ids: its
+ * elements are kept in pages of 1024 elements allocated on the first write to
+ * them and freed when they become empty, so memory follows the pages in use
+ * and not the highest position. Iterating skips missing pages whole, spans
+ * never cross a page and GARRAY_MAX_VALUE can not be a position. Clones share
+ * the pages and copy them as they are written
+ * garray_TYPE garray_TYPE_new_paged();
+ *
+ * Returns an empty segmented array: its elements are kept in segments that
+ * are never moved, the first of 16 elements and every next one as big as all
+ * the previous ones together. Growing allocates a new segment instead of
+ * copying the array, and the pointers returned by garray_TYPE_at() and
+ * garray_TYPE_iter_get() stay valid until the element is removed or the array
+ * is collapsed, sorted or freed. Spans never cross a segment
+ * garray_TYPE garray_TYPE_new_segmented();
+ *
+ * Returns an empty segmented array that several threads can use at the same
+ * time without locks: garray_TYPE_add(), garray_TYPE_set(),
+ * garray_TYPE_remove(), garray_TYPE_at(), garray_TYPE_at_default(),
+ * garray_TYPE_size() and GARRAY_FOREACH() may run concurrently. Adds claim a
+ * free position with atomic operations on values_setted and readers only see
+ * an element once it is written, but an element being overwritten or removed
+ * and added again can be read half written. Any other function needs the
+ * array to be used by a single thread
+ * garray_TYPE garray_TYPE_new_concurrent();
+ *
+ * Returns an empty sharded array, for threads that only append: each thread
+ * gets its own shard from garray_TYPE_sharded_shard() and adds to it with
+ * garray_TYPE_add() without sharing any memory with the others.
+ * garray_TYPE_sharded_merge() moves every element to a new array and
+ * garray_TYPE_sharded_snapshot() copies them, both while no thread is using
+ * its shard. Free it with garray_sharded_free()
+ * garray_sharded garray_TYPE_new_sharded();
+ *
+ * Returns a new dense array of sharded for the calling thread, that must be the
+ * only one using it. It is freed with sharded
+ * garray_TYPE garray_TYPE_sharded_shard(garray_sharded sharded);
+ *
+ * Returns a new array with the elements of every shard of sharded, shard
+ * after shard in the order they were created, and empties the shards
+ * garray_TYPE garray_TYPE_sharded_merge(garray_sharded sharded);
+ *
+ * Same as garray_TYPE_sharded_merge() but leaves the shards as they are
+ * garray_TYPE garray_TYPE_sharded_snapshot(garray_sharded sharded);
+ *
+ * Returns the array saved at path by garray_save(), mapping the file instead
+ * of reading it: opening takes the same time for any size, and
+ * garray_TYPE_at(), iteration and queries read the pages of the file as they
+ * touch them. With GARRAY_MAP_READONLY the array must not be modified, with
+ * GARRAY_MAP_PRIVATE changes are copy on write and never reach the file, and
+ * with GARRAY_MAP_SHARED they are written to the file, whose header is updated
+ * when the array is freed. Returns NULL with errno set if the file can not be
+ * mapped or was not saved from an array of TYPE
+ * garray_TYPE garray_TYPE_open_mmap(const char *path,
+ *                                   enum garray_map_mode mode);
+ *
+ * Reads an array written by garray_write() from stream, in the same mode it
+ * was written in, through a buffer of a bounded size. Returns NULL with errno
+ * set if it can not be read or was not written from an array of TYPE
+ * garray_TYPE garray_TYPE_read(FILE *stream);
+ *
  * Appends an element to the array
  * garray_index garray_TYPE_add(garray_TYPE a, TYPE data);
  *
@@ -93,17 +175,57 @@ typedef unsigned int garray_index;
  * be ignored. Also garray_TYPE_at() aborts if the value is unse
  * void garray_TYPE_remove(garray_TYPE a, garray_index position);
  *
+ * Adds the n elements of data, in the same positions that n calls to
+ * garray_TYPE_add() would use, growing the array at most once
+ * void garray_TYPE_add_many(garray_TYPE a, TYPE const *data, garray_index n);
+ *
+ * Sets the n values from position to the n elements of data, growing the array
+ * at most once
+ * void garray_TYPE_set_range(garray_TYPE a, garray_index position,
+ *                            TYPE const *data, garray_index n);
+ *
+ * Unsets the n values from position, positions outside of the array are
+ * ignored
+ * void garray_TYPE_remove_range(garray_TYPE a, garray_index position,
+ *                               garray_index n);
+ *
+ * Copies to out the values at the n positions, aborts like garray_TYPE_at()
+ * if a position is outside of bounds or unset
+ * void garray_TYPE_at_many(garray_TYPE a, garray_index const *positions,
+ *                          garray_index n, TYPE *out);
+ *
  * Returns the number of elements of the array
  * garray_index garray_TYPE_size(garray_TYPE a);
  *
  * Returns an exact copy of the array. Iterators of the original array are not
- * affected
+ * affected. The clone of a paged array shares its pages until they are written
  * garray_TYPE garray_TYPE_clone(garray_TYPE a);
  *
  * It gets rid of the unsetted values in the array reducing the allocated space
- * to the number of elements in the array
+ * to the number of elements in the array. The last elements fill the holes,
+ * unless they are at least 1/32 of the positions in use in an array of 4 or 8
+ * byte elements, which is compacted keeping the order
  * void garray_TYPE_collapse(garray_TYPE a);
  *
+ * Same as garray_TYPE_collapse() but the elements keep their order: every
+ * span of elements is moved down to right after the previous one
+ * void garray_TYPE_compact(garray_TYPE a);
+ *
+ * Compacts the array as garray_TYPE_compact() a few elements at a time:
+ * moves at most max_elements elements and returns true once no hole is left
+ * before an element. It does not shrink the array, compacting or collapsing it
+ * does. Elements added between steps go to the holes as usual
+ * bool garray_TYPE_compact_step(garray_TYPE a, garray_index max_elements);
+ *
+ * Compacts the array a step of step_elements elements at every remove once
+ * the holes reach max_hole_ratio of the positions in use, until it has no
+ * holes, so positions change on removes. Holes are counted by the removes since
+ * the array was last compacted, an upper bound. A max_hole_ratio or a
+ * step_elements of 0 turn it off. Dense and concurrent arrays ignore it and
+ * clones do not inherit it
+ * void garray_TYPE_set_auto_compaction(garray_TYPE a, double max_hole_ratio,
+ *                                      garray_index step_elements);
+ *
  * Returns a collapsed and sorted version of the input array according to
  * criteria
  * `criteria` == 0: None is before the other
@@ -112,10 +234,48 @@ typedef unsigned int garray_index;
  * garray_TYPE garray_TYPE_sort(garray_TYPE a,
  *                      int criteria(TYPE const *left, TYPE const *right));
  *
+ * Same as garray_TYPE_sort() but collapses and sorts the array itself instead
+ * of a copy
+ * void garray_TYPE_sort_inplace(garray_TYPE a,
+ *                      int criteria(TYPE const *left, TYPE const *right));
+ *
+ * Same as garray_TYPE_sort() but the array is split into num_threads chunks
+ * that are sorted and then merged by num_threads threads
+ * garray_TYPE garray_TYPE_sort_parallel(garray_TYPE a,
+ *                      int criteria(TYPE const *left, TYPE const *right),
+ *                      unsigned num_threads);
+ *
+ * Returns a collapsed version of the input array sorted in ascending order of
+ * the key of type key found key_offset bytes from the start of each element,
+ * with a stable radix sort in linear time
+ * garray_TYPE garray_TYPE_sort_radix(garray_TYPE a, enum garray_radix_key key,
+ *                      size_t key_offset);
+ *
+ * Same as garray_TYPE_sort_radix() but sorts by the value returned by key for
+ * each element, see garray_radix_key_i64() and the like to build it
+ * garray_TYPE garray_TYPE_sort_radix_by(garray_TYPE a,
+ *                      uint64_t key(TYPE const *element));
+ *
  * Returns true if value is contained in the array, according to comparator
  * bool garray_TYPE_contains(garray_TYPE a, TYPE value,
  *                      bool comparator(TYPE const *left, TYPE const *right))
  *
+ * Same as garray_TYPE_get(), garray_TYPE_query() and garray_TYPE_contains()
+ * but the array is scanned by every thread of pool at the same time, see
+ * garray_pool_new(). garray_TYPE_get_parallel() returns the same element than
+ * garray_TYPE_get(), and garray_TYPE_query_parallel() the elements in the same
+ * order than garray_TYPE_query(). condition and comparator are called from
+ * several threads at the same time
+ * TYPE const *garray_TYPE_get_parallel(garray_TYPE a, void* data,
+ *                          bool condition(TYPE const *value, void* data),
+ *                          garray_pool pool)
+ * garray_TYPE garray_TYPE_query_parallel(garray_TYPE a, void* data,
+ *                          bool condition(TYPE const *value, void* data),
+ *                          garray_pool pool)
+ * bool garray_TYPE_contains_parallel(garray_TYPE a, TYPE value,
+ *                      bool comparator(TYPE const *left, TYPE const *right),
+ *                      garray_pool pool)
+ *
  *
  *
  * Frees the array
@@ -160,11 +320,360 @@ typedef unsigned int garray_index;
  *
  * Frees the iterator
  * void garray_TYPE_iter_free(garray_TYPE_iter_int iterator);
+ *
+ * Same as garray_TYPE_iter_new() but uses iterator as storage instead of
+ * allocating it, so the returned iterator must not be freed. iterator is
+ * usually a local variable
+ * garray_TYPE_iter garray_TYPE_iter_init(garray_TYPE a,
+ *                              struct generic_array_iterator *iterator);
+ *
+ * Runs the statement that follows with ptr, a TYPE const *, pointing to every
+ * setted element, without allocating
+ * GARRAY_FOREACH(TYPE, a, ptr) statement
+ *
+ * Looks for the first run of consecutive setted elements at or after
+ * *position. Stores the index of its first element in *position and a pointer
+ * to it in *ptr, and returns its length, 0 if there are no more setted
+ * elements. Advance *position by the returned length to get the next run
+ * garray_index garray_TYPE_next_span(garray_TYPE a, garray_index *position,
+ *                                    TYPE const **ptr);
+ *
+ *
+ *
+ * GARRAY_IMPLEMENT_INLINE(DATA_TYPE) is an alternative to GARRAY_DECLARE() and
+ * GARRAY_IMPLEMENT() that defines every function as static inline, with
+ * garray_TYPE_add(), garray_TYPE_at(), garray_TYPE_at_default(),
+ * garray_TYPE_set() and the iterator functions accessing the array directly as
+ * an array of DATA_TYPE. Use it in every module that uses the type, and do not
+ * use GARRAY_DECLARE(DATA_TYPE) nor GARRAY_IMPLEMENT(DATA_TYPE) with it.
  */
 
+// Allocator of the memory of an array. reallocate() with a NULL ptr must
+// behave as allocate(). The sizes passed to reallocate() and deallocate() are
+// the ones the memory was allocated with, so the allocator does not need to
+// store them. context is passed to every function
+struct garray_allocator {
+  void *(*allocate)(void *context, size_t size);
+  void *(*reallocate)(void *context, void *ptr, size_t old_size,
+                      size_t new_size);
+  void (*deallocate)(void *context, void *ptr, size_t size);
+  void *context;
+};
+
+// Sets the allocator of the arrays created from now on without an explicit
+// one, NULL restores the default allocator that uses malloc()
+void garray_set_default_allocator(struct garray_allocator const *allocator);
+
+// A bump allocator. Allocations are carved from chunks of chunk_size bytes, or
+// bigger for bigger allocations, and freeing them does nothing except for the
+// last one. Not thread safe
+typedef struct garray_arena *garray_arena;
+
+garray_arena garray_arena_new(size_t chunk_size);
+
+struct garray_allocator const *garray_arena_allocator(garray_arena arena);
+
+// Releases at once everything allocated in the arena, arrays allocated in it
+// must not be used afterwards
+void garray_arena_reset(garray_arena arena);
+
+void garray_arena_free(garray_arena arena);
+
+// An allocator of blocks of block_size bytes, kept in a free list and carved
+// blocks_per_chunk at a time. Bigger allocations go to malloc(). Fits the
+// array headers and iterators. Not thread safe
+typedef struct garray_block_pool *garray_block_pool;
+
+garray_block_pool garray_block_pool_new(size_t block_size,
+                                        size_t blocks_per_chunk);
+
+struct garray_allocator const *
+garray_block_pool_allocator(garray_block_pool pool);
+
+// Frees the pool and every block in it
+void garray_block_pool_free(garray_block_pool pool);
+
+/*
+ * Internal layout of the array. It is only exposed so that the code generated
+ * by GARRAY_IMPLEMENT_INLINE() can access it directly, do not use it.
+ */
+typedef uint64_t garray_word;
+#define GARRAY_WORD_BITS 64
+#define GARRAY_LOG_B2_WORD_BITS 6
+#define GARRAY_WORD_FULL (~(garray_word)0)
+
+// Number of levels of the summary of full words of values_setted
+#define GARRAY_SUMMARY_LEVELS 2
+
+// Bytes of storage inside the header, used by arrays small enough to fit in it
+// before any allocation. Can be defined before including garray.h, with the
+// same value in every module. 0 disables it
+#ifndef GARRAY_INLINE_BYTES
+#define GARRAY_INLINE_BYTES 64
+#endif
+
+// Segmented arrays have a first segment of 2^GARRAY_LOG_B2_FIRST_SEGMENT
+// elements, every next one doubles the capacity
+#define GARRAY_LOG_B2_FIRST_SEGMENT 4
+
+struct generic_array {
+  garray_index capacity;                // Elements the data has room for
+  size_t bytes_allocated_values_setted; // Bytes allocated for values_setted
+  garray_index num_elements;            // Total number of elements
+  garray_index next_free; // There are no unsetted elements before it
+  size_t element_size;    // The size of each element in bytes
+  garray_word *values_setted; // Bit n is set if the element n is set
+  garray_word *full_summary[GARRAY_SUMMARY_LEVELS]; // Bit n of level 0 is set
+                                                    // if the word n of
+                                                    // values_setted is full,
+                                                    // every next level
+                                                    // summarizes the previous
+  int8_t *array; // A single block with the data followed by values_setted and
+                 // every level of full_summary
+  struct garray_allocator const *allocator; // Owns every allocation above
+  bool dense; // No holes, the elements are [0, num_elements) and there is no
+              // values_setted
+  bool paged; // The elements are in pages instead of array, see garray.c
+  int8_t ***page_tables;        // Paged arrays only, every table points to
+                                // pages and every page has its values_setted
+  garray_index num_page_tables; // Number of entries of page_tables
+  bool segmented;    // The data is in segments, array only has the bitmaps
+  int8_t **segments; // Segmented arrays only, segment n > 0 holds the elements
+                     // [2^(n - 1), 2^n) * 2^GARRAY_LOG_B2_FIRST_SEGMENT
+  struct garray_file *file; // Set while the block is a mapping of a file, see
+                            // garray_TYPE_open_mmap()
+  struct garray_concurrent *concurrent; // Set for the arrays of
+                                        // garray_TYPE_new_concurrent(), see
+                                        // garray.c
+  struct garray_compaction *compaction; // Set by
+                                        // garray_TYPE_set_auto_compaction()
+  garray_word inline_block[GARRAY_INLINE_BYTES / sizeof(garray_word) +
+                           (GARRAY_INLINE_BYTES == 0)]; // The block while it
+                                                        // fits in the header
+};
+
+struct generic_array_iterator {
+  bool valid_index;
+  garray_index index;
+  struct generic_array *garray;
+};
+
+#if defined(__GNUC__) || defined(__clang__)
+#define GARRAY_CTZ(word) ((garray_index)__builtin_ctzll(word))
+#define GARRAY_CLZ(word) ((garray_index)__builtin_clzll(word))
+// Reads that may race with the writers of a concurrent array
+#define GARRAY_LOAD_ACQUIRE(value) __atomic_load_n(&(value), __ATOMIC_ACQUIRE)
+#else
+#define GARRAY_LOAD_ACQUIRE(value) (value)
+
+static inline garray_index GARRAY_CTZ(garray_word word) {
+  garray_index n = 0;
+
+  while (!(word & 1)) {
+    word >>= 1;
+    n++;
+  }
+
+  return n;
+}
+
+static inline garray_index GARRAY_CLZ(garray_word word) {
+  garray_index n = 0;
+
+  while (!(word & ((garray_word)1 << (GARRAY_WORD_BITS - 1)))) {
+    word <<= 1;
+    n++;
+  }
+
+  return n;
+}
+#endif
+
 typedef struct generic_array *garray;
 typedef struct generic_array_iterator *garray_iter;
 
+// Address of the element at position of an array that is not paged, the
+// segment of a segmented array is found with a bit scan
+static inline void *___garray_slot(garray a, garray_index position,
+                                   size_t element_size) {
+  if (!a->segmented)
+    return a->array + position * element_size;
+
+  garray_index high = position >> GARRAY_LOG_B2_FIRST_SEGMENT;
+
+  if (high == 0)
+    return a->segments[0] + position * element_size;
+
+  garray_index segment = GARRAY_WORD_BITS - GARRAY_CLZ(high);
+
+  return a->segments[segment] +
+         (position - ((garray_index)1 << (segment - 1 +
+                                           GARRAY_LOG_B2_FIRST_SEGMENT))) *
+             element_size;
+}
+
+// State of GARRAY_FOREACH(), walks values_setted one word at a time or, on a
+// dense array, every index up to end. A paged array is walked a page at a time
+struct garray_foreach {
+  struct generic_array *garray;
+  bool dense;
+  bool paged;
+  garray_index end;
+  garray_index page;  // Next page to visit of a paged array
+  int8_t const *data; // Data of the page being visited, or of the array
+  garray_index first; // Index of the first element of data
+  garray_word const *words;
+  garray_index num_words;
+  garray_index word;  // Word of values_setted being visited
+  garray_word bits;   // Bits of the word not visited yet
+  garray_index index; // Index of the current element
+  bool stopped;       // Set while the body runs, left set by break
+};
+
+static inline struct garray_foreach ___garray_foreach_begin(garray a) {
+  int8_t const *array = GARRAY_LOAD_ACQUIRE(a->array);
+  garray_index capacity = array == NULL ? 0 : GARRAY_LOAD_ACQUIRE(a->capacity);
+  struct garray_foreach it = {
+      .garray = a,
+      .dense = a->dense,
+      .paged = a->paged,
+      .end = GARRAY_LOAD_ACQUIRE(a->num_elements),
+      .data = array,
+      .words = GARRAY_LOAD_ACQUIRE(a->values_setted),
+      .num_words = (capacity >> GARRAY_LOG_B2_WORD_BITS) +
+                   (capacity % GARRAY_WORD_BITS != 0),
+  };
+
+  if (!it.dense && !it.paged && it.num_words > 0)
+    it.bits = GARRAY_LOAD_ACQUIRE(it.words[0]);
+
+  return it;
+}
+
+// Moves a struct garray_foreach of a paged array to its next page, returns
+// false when there are no more
+bool ___garray_foreach_next_page(struct garray_foreach *it);
+
+// The element a struct garray_foreach is at
+static inline void const *
+___garray_foreach_get(struct garray_foreach const *it, size_t element_size) {
+  if (it->garray->segmented)
+    return ___garray_slot(it->garray, it->index, element_size);
+
+  return it->data + (it->index - it->first) * element_size;
+}
+
+// Moves to the next setted element, returns false when there are no more
+static inline bool ___garray_foreach_next(struct garray_foreach *it) {
+  if (it->dense) {
+    it->index = it->word++;
+    return it->index < it->end;
+  }
+
+  while (it->bits == 0) {
+    if (++it->word < it->num_words)
+      it->bits = GARRAY_LOAD_ACQUIRE(it->words[it->word]);
+    else if (!it->paged || !___garray_foreach_next_page(it))
+      return false;
+  }
+
+  it->index =
+      it->first + (it->word << GARRAY_LOG_B2_WORD_BITS) + GARRAY_CTZ(it->bits);
+  it->bits &= it->bits - 1;
+
+  return true;
+}
+
+// Runs the statement that follows with ptr pointing to every setted element of
+// the garray_TYPE a, in order. It does not allocate, and break and continue
+// work as in any loop. The body must not add elements to the array nor collapse
+// or sort it
+#define GARRAY_FOREACH(DATA_TYPE, a, ptr)                                      \
+  for (struct garray_foreach ___garray_foreach_##ptr =                         \
+           ___garray_foreach_begin(a);                                         \
+       !___garray_foreach_##ptr.stopped &&                                     \
+       ___garray_foreach_next(&___garray_foreach_##ptr);)                      \
+    for (DATA_TYPE const *ptr =                                                \
+             (___garray_foreach_##ptr.stopped = true,                          \
+              (DATA_TYPE const *)___garray_foreach_get(                        \
+                  &___garray_foreach_##ptr, sizeof(DATA_TYPE)));               \
+         ___garray_foreach_##ptr.stopped;                                      \
+         ___garray_foreach_##ptr.stopped = false)
+
+// A pool of threads for the parallel scans, see garray_pool_new()
+typedef struct garray_pool *garray_pool;
+
+// Returns a pool of num_threads threads, counting the thread that starts a
+// parallel scan, that also works on it. The pool can be reused by any number
+// of scans, but only one at a time
+garray_pool garray_pool_new(unsigned num_threads);
+
+// Stops the threads of the pool and frees it
+void garray_pool_free(garray_pool pool);
+
+// Appenders to a single array, one per thread, see garray_TYPE_new_sharded()
+typedef struct garray_sharded *garray_sharded;
+
+// Frees the sharded array and every one of its shards
+void garray_sharded_free(garray_sharded sharded);
+
+// How garray_TYPE_open_mmap() maps a file
+enum garray_map_mode {
+  GARRAY_MAP_READONLY,
+  GARRAY_MAP_PRIVATE,
+  GARRAY_MAP_SHARED,
+};
+
+// Writes the array to path in the versioned format of garray_TYPE_open_mmap():
+// a header and then the data and values_setted as they are in memory, a
+// segmented array is written as a flat one. Paged arrays can not be saved.
+// Returns false with errno set on failure
+bool garray_save(garray a, const char *path);
+
+// Writes the array to stream to be read back with garray_TYPE_read(): a header
+// and then each span of setted elements after the number of unsetted positions
+// before it, so holes take a couple of bytes whatever their length. Nothing is
+// copied to a buffer but by stdio. Returns false with errno set on failure
+bool garray_write(garray a, FILE *stream);
+
+// Type of the key that garray_TYPE_sort_radix() sorts by
+enum garray_radix_key {
+  GARRAY_RADIX_U32,
+  GARRAY_RADIX_I32,
+  GARRAY_RADIX_F32,
+  GARRAY_RADIX_U64,
+  GARRAY_RADIX_I64,
+  GARRAY_RADIX_F64,
+};
+
+// Map a value to an unsigned key that sorts in the same order, to be returned
+// by the key function of garray_TYPE_sort_radix_by()
+static inline uint64_t garray_radix_key_i32(int32_t value) {
+  return (uint32_t)value ^ 0x80000000u;
+}
+
+static inline uint64_t garray_radix_key_i64(int64_t value) {
+  return (uint64_t)value ^ ((uint64_t)1 << 63);
+}
+
+// Negative floats have every bit flipped so that bigger magnitudes sort first,
+// positive floats only the sign bit so that they sort after the negative ones
+static inline uint64_t garray_radix_key_f32(float value) {
+  uint32_t bits;
+
+  memcpy(&bits, &value, sizeof(bits));
+
+  return bits & 0x80000000u ? (uint32_t)~bits : bits | 0x80000000u;
+}
+
+static inline uint64_t garray_radix_key_f64(double value) {
+  uint64_t bits;
+
+  memcpy(&bits, &value, sizeof(bits));
+
+  return bits & ((uint64_t)1 << 63) ? ~bits : bits | ((uint64_t)1 << 63);
+}
+
 // Declare the array of type DATA_TYPE to use it when the array for that type
 // has already been implemented at some other place
 #define GARRAY_DECLARE(DATA_TYPE)                                              \
@@ -176,6 +685,33 @@ typedef struct generic_array_iterator *garray_iter;
   garray_##DATA_TYPE garray_##DATA_TYPE##_new_preallocated(                    \
       garray_index num_elements_preallocated);                                 \
                                                                                \
+  garray_##DATA_TYPE garray_##DATA_TYPE##_new_with_allocator(                  \
+      struct garray_allocator const *allocator);                               \
+                                                                               \
+  garray_##DATA_TYPE garray_##DATA_TYPE##_new_dense();                         \
+                                                                               \
+  garray_##DATA_TYPE garray_##DATA_TYPE##_new_paged();                         \
+                                                                               \
+  garray_##DATA_TYPE garray_##DATA_TYPE##_new_segmented();                     \
+                                                                               \
+  garray_##DATA_TYPE garray_##DATA_TYPE##_new_concurrent();                    \
+                                                                               \
+  garray_sharded garray_##DATA_TYPE##_new_sharded();                           \
+                                                                               \
+  garray_##DATA_TYPE garray_##DATA_TYPE##_sharded_shard(                       \
+      garray_sharded sharded);                                                 \
+                                                                               \
+  garray_##DATA_TYPE garray_##DATA_TYPE##_sharded_merge(                       \
+      garray_sharded sharded);                                                 \
+                                                                               \
+  garray_##DATA_TYPE garray_##DATA_TYPE##_sharded_snapshot(                    \
+      garray_sharded sharded);                                                 \
+                                                                               \
+  garray_##DATA_TYPE garray_##DATA_TYPE##_open_mmap(                           \
+      const char *path, enum garray_map_mode mode);                            \
+                                                                               \
+  garray_##DATA_TYPE garray_##DATA_TYPE##_read(FILE *stream);                  \
+                                                                               \
   garray_index garray_##DATA_TYPE##_add(garray_##DATA_TYPE a, DATA_TYPE data); \
                                                                                \
   DATA_TYPE const *garray_##DATA_TYPE##_at(garray_##DATA_TYPE a,               \
@@ -193,23 +729,78 @@ typedef struct generic_array_iterator *garray_iter;
       garray_##DATA_TYPE a, void *data,                                        \
       bool condition(DATA_TYPE const *value, void *data));                     \
                                                                                \
+  DATA_TYPE const *garray_##DATA_TYPE##_get_parallel(                          \
+      garray_##DATA_TYPE a, void *data,                                        \
+      bool condition(DATA_TYPE const *value, void *data), garray_pool pool);   \
+                                                                               \
+  garray_##DATA_TYPE garray_##DATA_TYPE##_query_parallel(                      \
+      garray_##DATA_TYPE a, void *data,                                        \
+      bool condition(DATA_TYPE const *value, void *data), garray_pool pool);   \
+                                                                               \
+  void garray_##DATA_TYPE##_set(garray_##DATA_TYPE a, garray_index position,   \
+                                DATA_TYPE data);                               \
+                                                                               \
   garray_index garray_##DATA_TYPE##_size(garray_##DATA_TYPE a);                \
                                                                                \
   void garray_##DATA_TYPE##_remove(garray_##DATA_TYPE a,                       \
                                    garray_index position);                     \
                                                                                \
+  void garray_##DATA_TYPE##_add_many(garray_##DATA_TYPE a,                     \
+                                     DATA_TYPE const *data, garray_index n);   \
+                                                                               \
+  void garray_##DATA_TYPE##_set_range(garray_##DATA_TYPE a,                    \
+                                      garray_index position,                   \
+                                      DATA_TYPE const *data, garray_index n);  \
+                                                                               \
+  void garray_##DATA_TYPE##_remove_range(garray_##DATA_TYPE a,                 \
+                                         garray_index position,                \
+                                         garray_index n);                      \
+                                                                               \
+  void garray_##DATA_TYPE##_at_many(garray_##DATA_TYPE a,                      \
+                                    garray_index const *positions,             \
+                                    garray_index n, DATA_TYPE *out);           \
+                                                                               \
   garray_##DATA_TYPE garray_##DATA_TYPE##_clone(garray_##DATA_TYPE a);         \
                                                                                \
   void garray_##DATA_TYPE##_collapse(garray_##DATA_TYPE a);                    \
                                                                                \
+  void garray_##DATA_TYPE##_compact(garray_##DATA_TYPE a);                     \
+                                                                               \
+  bool garray_##DATA_TYPE##_compact_step(garray_##DATA_TYPE a,                 \
+                                         garray_index max_elements);           \
+                                                                               \
+  void garray_##DATA_TYPE##_set_auto_compaction(                               \
+      garray_##DATA_TYPE a, double max_hole_ratio,                             \
+      garray_index step_elements);                                             \
+                                                                               \
   garray_##DATA_TYPE garray_##DATA_TYPE##_sort(                                \
       garray_##DATA_TYPE a,                                                    \
       int criteria(DATA_TYPE const *, DATA_TYPE const *));                     \
                                                                                \
+  void garray_##DATA_TYPE##_sort_inplace(                                      \
+      garray_##DATA_TYPE a,                                                    \
+      int criteria(DATA_TYPE const *, DATA_TYPE const *));                     \
+                                                                               \
+  garray_##DATA_TYPE garray_##DATA_TYPE##_sort_parallel(                       \
+      garray_##DATA_TYPE a,                                                    \
+      int criteria(DATA_TYPE const *, DATA_TYPE const *),                      \
+      unsigned num_threads);                                                   \
+                                                                               \
+  garray_##DATA_TYPE garray_##DATA_TYPE##_sort_radix(                          \
+      garray_##DATA_TYPE a, enum garray_radix_key key, size_t key_offset);     \
+                                                                               \
+  garray_##DATA_TYPE garray_##DATA_TYPE##_sort_radix_by(                       \
+      garray_##DATA_TYPE a, uint64_t key(DATA_TYPE const *element));           \
+                                                                               \
   bool garray_##DATA_TYPE##_contains(                                          \
       garray_##DATA_TYPE a, DATA_TYPE value,                                   \
       bool comparator(DATA_TYPE const *left, DATA_TYPE const *right));         \
                                                                                \
+  bool garray_##DATA_TYPE##_contains_parallel(                                 \
+      garray_##DATA_TYPE a, DATA_TYPE value,                                   \
+      bool comparator(DATA_TYPE const *left, DATA_TYPE const *right),          \
+      garray_pool pool);                                                       \
+                                                                               \
   void garray_##DATA_TYPE##_free(garray_##DATA_TYPE a);                        \
                                                                                \
   garray_##DATA_TYPE##_iter garray_##DATA_TYPE##_iter_new(                     \
@@ -237,16 +828,37 @@ typedef struct generic_array_iterator *garray_iter;
   bool garray_##DATA_TYPE##_iter_set_index(garray_##DATA_TYPE##_iter iterator, \
                                            garray_index index);                \
                                                                                \
-  void garray_##DATA_TYPE##_iter_free(garray_##DATA_TYPE##_iter iterator);
-
-// Implement the array for the type DATA_TYPE --------------------------------
-#define GARRAY_IMPLEMENT(DATA_TYPE)                                            \
-  typedef struct generic_array *garray_##DATA_TYPE;                            \
-  typedef struct generic_array_iter *garray_##DATA_TYPE##_iter;                \
+  void garray_##DATA_TYPE##_iter_free(garray_##DATA_TYPE##_iter iterator);     \
+                                                                               \
+  garray_##DATA_TYPE##_iter garray_##DATA_TYPE##_iter_init(                    \
+      garray_##DATA_TYPE a, struct generic_array_iterator *iterator);          \
                                                                                \
+  garray_index garray_##DATA_TYPE##_next_span(                                 \
+      garray_##DATA_TYPE a, garray_index *position, DATA_TYPE const **ptr);
+
+// Declarations of the untyped functions that implement every array
+#define ___GARRAY_CORE                                                         \
   garray ___garray_new(garray_index element_size);                             \
+  garray ___garray_new_with_allocator(                                         \
+      garray_index element_size, struct garray_allocator const *allocator);    \
   garray ___garray_new_preallocated(garray_index num_elements_preallocated,    \
                                     garray_index element_size);                \
+  garray ___garray_new_dense(garray_index element_size,                        \
+                             struct garray_allocator const *allocator);        \
+  garray ___garray_new_paged(garray_index element_size,                        \
+                             struct garray_allocator const *allocator);        \
+  garray ___garray_new_segmented(garray_index element_size,                    \
+                                 struct garray_allocator const *allocator);    \
+  garray ___garray_new_concurrent(garray_index element_size,                   \
+                                  struct garray_allocator const *allocator);   \
+  garray_sharded ___garray_sharded_new(garray_index element_size);             \
+  garray ___garray_sharded_shard(garray_sharded sharded);                      \
+  garray ___garray_sharded_merge(garray_sharded sharded, bool empty_shards);   \
+  garray ___garray_open_mmap(const char *path, garray_index element_size,      \
+                             enum garray_map_mode mode);                       \
+  garray ___garray_read(FILE *stream, garray_index element_size);              \
+  void *___garray_flatten(garray a);                                           \
+  void ___garray_unflatten(garray a, void *elements);                          \
   garray_index ___garray_add(garray a, const void *data);                      \
   const void *___garray_at(garray a, garray_index position);                   \
   const void *___garray_at_default(garray a, garray_index position,            \
@@ -254,12 +866,33 @@ typedef struct generic_array_iterator *garray_iter;
   void ___garray_set(garray a, garray_index position,                          \
                      const void *restrict data);                               \
   void ___garray_remove(garray a, garray_index position);                      \
+  void ___garray_add_many(garray a, const void *data, garray_index n);         \
+  void ___garray_set_range(garray a, garray_index position,                    \
+                           const void *restrict data, garray_index n);         \
+  void ___garray_remove_range(garray a, garray_index position,                 \
+                              garray_index n);                                 \
+  void ___garray_at_many(garray a, const garray_index *positions,              \
+                         garray_index n, void *out);                           \
   garray_index ___garray_size(garray a);                                       \
   garray ___garray_clone(garray a);                                            \
   void ___garray_collapse(garray a);                                           \
+  void ___garray_compact(garray a);                                            \
+  bool ___garray_compact_step(garray a, garray_index max_elements);            \
+  void ___garray_set_auto_compaction(garray a, double max_hole_ratio,          \
+                                     garray_index step_elements);              \
   garray ___garray_sort(garray a, int criteria(void const *, void const *));   \
+  garray ___garray_sort_parallel(                                              \
+      garray a, int criteria(void const *, void const *),                      \
+      unsigned num_threads,                                                    \
+      void sort_chunk(void *base, size_t num_elements,                         \
+                      int criteria(void const *, void const *)));              \
+  garray ___garray_sort_radix(garray a, enum garray_radix_key key,             \
+                              size_t key_offset);                              \
+  garray ___garray_sort_radix_by(garray a,                                     \
+                                 uint64_t key(void const *element));           \
   void ___garray_free(garray a);                                               \
   garray_iter ___garray_iter_new(garray a);                                    \
+  garray_iter ___garray_iter_init(garray a, garray_iter iterator);             \
   bool ___garray_iter_condition(garray_iter iterator);                         \
   void ___garray_iter_free(garray_iter iterator);                              \
   bool ___garray_iter_condition_free(garray_iter iterator);                    \
@@ -269,6 +902,8 @@ typedef struct generic_array_iterator *garray_iter;
   void ___garray_iter_set(garray_iter iterator, const void *data);             \
   garray_index ___garray_iter_get_index(garray_iter iterator);                 \
   bool ___garray_iter_set_index(garray_iter iterator, garray_index index);     \
+  garray_index ___garray_next_span(garray a, garray_index *position,           \
+                                   void const **ptr);                          \
   bool ___garray_contains(                                                     \
       garray a, const void *value,                                             \
       bool comparator(void const *left, void const *right));                   \
@@ -276,134 +911,662 @@ typedef struct generic_array_iterator *garray_iter;
                          bool condition(void const *value, void *data));       \
   void const *___garray_get(garray a, void *data,                              \
                             bool condition(void const *value, void *data));    \
+  garray ___garray_query_parallel(                                             \
+      garray a, void *data, bool condition(void const *value, void *data),     \
+      garray_pool pool);                                                       \
+  void const *___garray_get_parallel(                                          \
+      garray a, void *data, bool condition(void const *value, void *data),     \
+      garray_pool pool);                                                       \
+  bool ___garray_contains_parallel(                                            \
+      garray a, const void *value,                                             \
+      bool comparator(void const *left, void const *right), garray_pool pool);
+
+// Hot path functions implemented by forwarding to the untyped functions
+#define ___GARRAY_FORWARD_HOT(DATA_TYPE, LINKAGE)                              \
+  LINKAGE garray_index garray_##DATA_TYPE##_add(garray_##DATA_TYPE a,          \
+                                                DATA_TYPE data) {              \
+    return ___garray_add(a, &data);                                            \
+  }                                                                            \
+                                                                               \
+  LINKAGE DATA_TYPE const *garray_##DATA_TYPE##_at(                            \
+      garray_##DATA_TYPE a, garray_index position) {                           \
+    return ___garray_at(a, position);                                          \
+  }                                                                            \
                                                                                \
-  extern inline garray_##DATA_TYPE garray_##DATA_TYPE##_new() {                \
+  LINKAGE DATA_TYPE const *garray_##DATA_TYPE##_at_default(                    \
+      garray_##DATA_TYPE a, garray_index position,                             \
+      DATA_TYPE const *default_value) {                                        \
+    return ___garray_at_default(a, position, default_value);                   \
+  }                                                                            \
+                                                                               \
+  LINKAGE void garray_##DATA_TYPE##_set(                                       \
+      garray_##DATA_TYPE a, garray_index position, DATA_TYPE data) {           \
+    ___garray_set(a, position, &data);                                         \
+  }                                                                            \
+                                                                               \
+  LINKAGE bool garray_##DATA_TYPE##_iter_condition(                            \
+      garray_##DATA_TYPE##_iter iterator) {                                    \
+    return ___garray_iter_condition((garray_iter)iterator);                    \
+  }                                                                            \
+                                                                               \
+  LINKAGE void garray_##DATA_TYPE##_iter_next(                                 \
+      garray_##DATA_TYPE##_iter iterator) {                                    \
+    ___garray_iter_next((garray_iter)iterator);                                \
+  }                                                                            \
+                                                                               \
+  LINKAGE DATA_TYPE const *garray_##DATA_TYPE##_iter_get(                      \
+      garray_##DATA_TYPE##_iter iterator) {                                    \
+    return ___garray_iter_get((garray_iter)iterator);                          \
+  }
+
+// Functions that always forward to the untyped functions
+#define ___GARRAY_FORWARD_COLD(DATA_TYPE, LINKAGE)                             \
+  LINKAGE garray_##DATA_TYPE garray_##DATA_TYPE##_new() {                      \
     return ___garray_new(sizeof(DATA_TYPE));                                   \
   }                                                                            \
                                                                                \
-  extern inline garray_##DATA_TYPE garray_##DATA_TYPE##_new_preallocated(      \
+  LINKAGE garray_##DATA_TYPE garray_##DATA_TYPE##_new_preallocated(            \
       garray_index num_elements_preallocated) {                                \
     return ___garray_new_preallocated(num_elements_preallocated,               \
                                       sizeof(DATA_TYPE));                      \
   }                                                                            \
                                                                                \
-  extern inline garray_index garray_##DATA_TYPE##_add(garray_##DATA_TYPE a,    \
-                                                      DATA_TYPE data) {        \
-    return ___garray_add(a, &data);                                            \
+  LINKAGE garray_##DATA_TYPE garray_##DATA_TYPE##_new_with_allocator(          \
+      struct garray_allocator const *allocator) {                              \
+    return ___garray_new_with_allocator(sizeof(DATA_TYPE), allocator);         \
   }                                                                            \
                                                                                \
-  extern inline DATA_TYPE const *garray_##DATA_TYPE##_at(                      \
-      garray_##DATA_TYPE a, garray_index position) {                           \
-    return ___garray_at(a, position);                                          \
+  LINKAGE garray_##DATA_TYPE garray_##DATA_TYPE##_new_dense() {                \
+    return ___garray_new_dense(sizeof(DATA_TYPE), NULL);                       \
   }                                                                            \
                                                                                \
-  extern inline DATA_TYPE const *garray_##DATA_TYPE##_at_default(              \
-      garray_##DATA_TYPE a, garray_index position,                             \
-      DATA_TYPE const *default_value) {                                        \
-    return ___garray_at_default(a, position, default_value);                   \
+  LINKAGE garray_##DATA_TYPE garray_##DATA_TYPE##_new_paged() {                \
+    return ___garray_new_paged(sizeof(DATA_TYPE), NULL);                       \
   }                                                                            \
                                                                                \
-  extern inline void garray_##DATA_TYPE##_set(                                 \
-      garray_##DATA_TYPE a, garray_index position, DATA_TYPE data) {           \
-    ___garray_set(a, position, &data);                                         \
+  LINKAGE garray_##DATA_TYPE garray_##DATA_TYPE##_new_segmented() {            \
+    return ___garray_new_segmented(sizeof(DATA_TYPE), NULL);                   \
+  }                                                                            \
+                                                                               \
+  LINKAGE garray_##DATA_TYPE garray_##DATA_TYPE##_new_concurrent() {           \
+    return ___garray_new_concurrent(sizeof(DATA_TYPE), NULL);                  \
+  }                                                                            \
+                                                                               \
+  LINKAGE garray_sharded garray_##DATA_TYPE##_new_sharded() {                  \
+    return ___garray_sharded_new(sizeof(DATA_TYPE));                           \
+  }                                                                            \
+                                                                               \
+  LINKAGE garray_##DATA_TYPE garray_##DATA_TYPE##_sharded_shard(               \
+      garray_sharded sharded) {                                                \
+    return ___garray_sharded_shard(sharded);                                   \
+  }                                                                            \
+                                                                               \
+  LINKAGE garray_##DATA_TYPE garray_##DATA_TYPE##_sharded_merge(               \
+      garray_sharded sharded) {                                                \
+    return ___garray_sharded_merge(sharded, true);                             \
+  }                                                                            \
+                                                                               \
+  LINKAGE garray_##DATA_TYPE garray_##DATA_TYPE##_sharded_snapshot(            \
+      garray_sharded sharded) {                                                \
+    return ___garray_sharded_merge(sharded, false);                            \
   }                                                                            \
                                                                                \
-  extern inline void garray_##DATA_TYPE##_remove(garray_##DATA_TYPE a,         \
-                                                 garray_index position) {      \
+  LINKAGE garray_##DATA_TYPE garray_##DATA_TYPE##_open_mmap(                   \
+      const char *path, enum garray_map_mode mode) {                           \
+    return ___garray_open_mmap(path, sizeof(DATA_TYPE), mode);                 \
+  }                                                                            \
+                                                                               \
+  LINKAGE garray_##DATA_TYPE garray_##DATA_TYPE##_read(FILE *stream) {         \
+    return ___garray_read(stream, sizeof(DATA_TYPE));                          \
+  }                                                                            \
+                                                                               \
+  LINKAGE void garray_##DATA_TYPE##_remove(garray_##DATA_TYPE a,               \
+                                           garray_index position) {            \
     ___garray_remove(a, position);                                             \
   }                                                                            \
                                                                                \
-  extern inline garray_index garray_##DATA_TYPE##_size(garray_##DATA_TYPE a) { \
+  LINKAGE void garray_##DATA_TYPE##_add_many(                                  \
+      garray_##DATA_TYPE a, DATA_TYPE const *data, garray_index n) {           \
+    ___garray_add_many(a, data, n);                                            \
+  }                                                                            \
+                                                                               \
+  LINKAGE void garray_##DATA_TYPE##_set_range(garray_##DATA_TYPE a,            \
+                                              garray_index position,           \
+                                              DATA_TYPE const *data,           \
+                                              garray_index n) {                \
+    ___garray_set_range(a, position, data, n);                                 \
+  }                                                                            \
+                                                                               \
+  LINKAGE void garray_##DATA_TYPE##_remove_range(                              \
+      garray_##DATA_TYPE a, garray_index position, garray_index n) {           \
+    ___garray_remove_range(a, position, n);                                    \
+  }                                                                            \
+                                                                               \
+  LINKAGE void garray_##DATA_TYPE##_at_many(                                   \
+      garray_##DATA_TYPE a, garray_index const *positions, garray_index n,     \
+      DATA_TYPE *out) {                                                        \
+    ___garray_at_many(a, positions, n, out);                                   \
+  }                                                                            \
+                                                                               \
+  LINKAGE garray_index garray_##DATA_TYPE##_size(garray_##DATA_TYPE a) {       \
     return ___garray_size(a);                                                  \
   }                                                                            \
                                                                                \
-  extern inline garray_##DATA_TYPE garray_##DATA_TYPE##_clone(                 \
+  LINKAGE garray_##DATA_TYPE garray_##DATA_TYPE##_clone(                       \
       garray_##DATA_TYPE a) {                                                  \
     return ___garray_clone(a);                                                 \
   }                                                                            \
                                                                                \
-  extern inline void garray_##DATA_TYPE##_collapse(garray_##DATA_TYPE a) {     \
+  LINKAGE void garray_##DATA_TYPE##_collapse(garray_##DATA_TYPE a) {           \
     ___garray_collapse(a);                                                     \
   }                                                                            \
                                                                                \
-  extern inline garray_##DATA_TYPE garray_##DATA_TYPE##_sort(                  \
-      garray_##DATA_TYPE a,                                                    \
-      int criteria(DATA_TYPE const *, DATA_TYPE const *)) {                    \
-    return ___garray_sort(a, (int (*)(void const *, void const *))criteria);   \
+  LINKAGE void garray_##DATA_TYPE##_compact(garray_##DATA_TYPE a) {            \
+    ___garray_compact(a);                                                      \
   }                                                                            \
                                                                                \
-  extern inline void garray_##DATA_TYPE##_free(garray_##DATA_TYPE a) {         \
+  LINKAGE bool garray_##DATA_TYPE##_compact_step(garray_##DATA_TYPE a,         \
+                                                 garray_index max_elements) {  \
+    return ___garray_compact_step(a, max_elements);                            \
+  }                                                                            \
+                                                                               \
+  LINKAGE void garray_##DATA_TYPE##_set_auto_compaction(                       \
+      garray_##DATA_TYPE a, double max_hole_ratio,                             \
+      garray_index step_elements) {                                            \
+    ___garray_set_auto_compaction(a, max_hole_ratio, step_elements);           \
+  }                                                                            \
+                                                                               \
+  LINKAGE void garray_##DATA_TYPE##_free(garray_##DATA_TYPE a) {               \
     ___garray_free(a);                                                         \
   }                                                                            \
                                                                                \
-  extern inline garray_##DATA_TYPE##_iter garray_##DATA_TYPE##_iter_new(       \
+  LINKAGE garray_##DATA_TYPE##_iter garray_##DATA_TYPE##_iter_new(             \
       garray_##DATA_TYPE a) {                                                  \
     return (garray_##DATA_TYPE##_iter)___garray_iter_new(a);                   \
   }                                                                            \
                                                                                \
-  extern inline bool garray_##DATA_TYPE##_iter_condition(                      \
-      garray_##DATA_TYPE##_iter iterator) {                                    \
-    return ___garray_iter_condition((garray_iter)iterator);                    \
+  LINKAGE garray_##DATA_TYPE##_iter garray_##DATA_TYPE##_iter_init(            \
+      garray_##DATA_TYPE a, struct generic_array_iterator *iterator) {         \
+    return (garray_##DATA_TYPE##_iter)___garray_iter_init(a, iterator);        \
   }                                                                            \
                                                                                \
-  extern inline void garray_##DATA_TYPE##_iter_free(                           \
+  LINKAGE void garray_##DATA_TYPE##_iter_free(                                 \
       garray_##DATA_TYPE##_iter iterator) {                                    \
     ___garray_iter_free((garray_iter)iterator);                                \
   }                                                                            \
                                                                                \
-  extern inline bool garray_##DATA_TYPE##_iter_condition_free(                 \
+  LINKAGE bool garray_##DATA_TYPE##_iter_condition_free(                       \
       garray_##DATA_TYPE##_iter iterator) {                                    \
     return ___garray_iter_condition_free((garray_iter)iterator);               \
   }                                                                            \
                                                                                \
-  extern inline void garray_##DATA_TYPE##_iter_next(                           \
-      garray_##DATA_TYPE##_iter iterator) {                                    \
-    ___garray_iter_next((garray_iter)iterator);                                \
-  }                                                                            \
-                                                                               \
-  extern inline void garray_##DATA_TYPE##_iter_previous(                       \
+  LINKAGE void garray_##DATA_TYPE##_iter_previous(                             \
       garray_##DATA_TYPE##_iter iterator) {                                    \
     ___garray_iter_previous((garray_iter)iterator);                            \
   }                                                                            \
                                                                                \
-  extern inline DATA_TYPE const *garray_##DATA_TYPE##_iter_get(                \
-      garray_##DATA_TYPE##_iter iterator) {                                    \
-    return ___garray_iter_get((garray_iter)iterator);                          \
-  }                                                                            \
-                                                                               \
-  extern inline void garray_##DATA_TYPE##_iter_set(                            \
+  LINKAGE void garray_##DATA_TYPE##_iter_set(                                  \
       garray_##DATA_TYPE##_iter iterator, DATA_TYPE data) {                    \
     ___garray_iter_set((garray_iter)iterator, (void const *)&data);            \
   }                                                                            \
                                                                                \
-  extern inline garray_index garray_##DATA_TYPE##_iter_get_index(              \
+  LINKAGE garray_index garray_##DATA_TYPE##_iter_get_index(                    \
       garray_##DATA_TYPE##_iter iterator) {                                    \
     return ___garray_iter_get_index((garray_iter)iterator);                    \
   }                                                                            \
                                                                                \
-  extern inline bool garray_##DATA_TYPE##_iter_set_index(                      \
+  LINKAGE bool garray_##DATA_TYPE##_iter_set_index(                            \
       garray_##DATA_TYPE##_iter iterator, garray_index index) {                \
     return ___garray_iter_set_index((garray_iter)iterator, index);             \
   }                                                                            \
                                                                                \
-  extern inline bool garray_##DATA_TYPE##_contains(                            \
+  LINKAGE garray_index garray_##DATA_TYPE##_next_span(                         \
+      garray_##DATA_TYPE a, garray_index *position, DATA_TYPE const **ptr) {   \
+    return ___garray_next_span(a, position, (void const **)ptr);               \
+  }                                                                            \
+                                                                               \
+  LINKAGE bool garray_##DATA_TYPE##_contains(                                  \
       garray_##DATA_TYPE a, DATA_TYPE value,                                   \
       bool comparator(DATA_TYPE const *left, DATA_TYPE const *right)) {        \
     return ___garray_contains(                                                 \
         a, &value, (bool (*)(void const *, void const *))comparator);          \
   }                                                                            \
                                                                                \
-  extern inline garray_##DATA_TYPE garray_##DATA_TYPE##_query(                 \
+  LINKAGE garray_##DATA_TYPE garray_##DATA_TYPE##_query(                       \
       garray_##DATA_TYPE a, void *data,                                        \
       bool condition(DATA_TYPE const *value, void *data)) {                    \
     return ___garray_query(a, data,                                            \
                            (bool (*)(void const *, void *))condition);         \
   }                                                                            \
                                                                                \
-  extern inline DATA_TYPE const *garray_##DATA_TYPE##_get(                     \
+  LINKAGE DATA_TYPE const *garray_##DATA_TYPE##_get(                           \
       garray_##DATA_TYPE a, void *data,                                        \
       bool condition(DATA_TYPE const *value, void *data)) {                    \
     return ___garray_get(a, data, (bool (*)(void const *, void *))condition);  \
+  }                                                                            \
+                                                                               \
+  LINKAGE bool garray_##DATA_TYPE##_contains_parallel(                         \
+      garray_##DATA_TYPE a, DATA_TYPE value,                                   \
+      bool comparator(DATA_TYPE const *left, DATA_TYPE const *right),          \
+      garray_pool pool) {                                                      \
+    return ___garray_contains_parallel(                                        \
+        a, &value, (bool (*)(void const *, void const *))comparator, pool);    \
+  }                                                                            \
+                                                                               \
+  LINKAGE garray_##DATA_TYPE garray_##DATA_TYPE##_query_parallel(              \
+      garray_##DATA_TYPE a, void *data,                                        \
+      bool condition(DATA_TYPE const *value, void *data), garray_pool pool) {  \
+    return ___garray_query_parallel(                                           \
+        a, data, (bool (*)(void const *, void *))condition, pool);             \
+  }                                                                            \
+                                                                               \
+  LINKAGE DATA_TYPE const *garray_##DATA_TYPE##_get_parallel(                  \
+      garray_##DATA_TYPE a, void *data,                                        \
+      bool condition(DATA_TYPE const *value, void *data), garray_pool pool) {  \
+    return ___garray_get_parallel(                                             \
+        a, data, (bool (*)(void const *, void *))condition, pool);             \
+  }
+
+// Introsort over an array of DATA_TYPE, generates NAME(base, n, criteria).
+// CRITERIA is called as CRITERIA(left, right) to compare two elements, it is
+// either the criteria parameter or the name of a function known at compile
+// time, in that case it can be inlined and the parameter is ignored
+#define ___GARRAY_SORT_ENGINE(NAME, DATA_TYPE, CRITERIA)                       \
+  static inline void NAME##_insertion(                                         \
+      DATA_TYPE *base, size_t n,                                               \
+      int (*criteria)(DATA_TYPE const *, DATA_TYPE const *)) {                 \
+    (void)criteria;                                                            \
+                                                                               \
+    for (size_t i = 1; i < n; i++) {                                           \
+      DATA_TYPE value = base[i];                                               \
+      size_t j = i;                                                            \
+                                                                               \
+      for (; j > 0 && CRITERIA(&value, &base[j - 1]) < 0; j--)                 \
+        base[j] = base[j - 1];                                                 \
+                                                                               \
+      base[j] = value;                                                         \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  static inline void NAME##_sift_down(                                         \
+      DATA_TYPE *base, size_t root, size_t n,                                  \
+      int (*criteria)(DATA_TYPE const *, DATA_TYPE const *)) {                 \
+    DATA_TYPE value = base[root];                                              \
+    size_t child;                                                              \
+                                                                               \
+    (void)criteria;                                                            \
+                                                                               \
+    for (; (child = 2 * root + 1) < n; root = child) {                         \
+      if (child + 1 < n && CRITERIA(&base[child], &base[child + 1]) < 0)       \
+        child++;                                                               \
+                                                                               \
+      if (!(CRITERIA(&value, &base[child]) < 0))                               \
+        break;                                                                 \
+                                                                               \
+      base[root] = base[child];                                                \
+    }                                                                          \
+                                                                               \
+    base[root] = value;                                                        \
+  }                                                                            \
+                                                                               \
+  static inline void NAME##_heapsort(                                          \
+      DATA_TYPE *base, size_t n,                                               \
+      int (*criteria)(DATA_TYPE const *, DATA_TYPE const *)) {                 \
+    for (size_t start = n / 2; start-- > 0;)                                   \
+      NAME##_sift_down(base, start, n, criteria);                              \
+                                                                               \
+    for (size_t end = n; end-- > 1;) {                                         \
+      DATA_TYPE tmp = base[0];                                                 \
+      base[0] = base[end];                                                     \
+      base[end] = tmp;                                                         \
+      NAME##_sift_down(base, 0, end, criteria);                                \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  static inline void NAME##_loop(                                              \
+      DATA_TYPE *base, size_t n, size_t depth,                                 \
+      int (*criteria)(DATA_TYPE const *, DATA_TYPE const *)) {                 \
+    (void)criteria;                                                            \
+                                                                               \
+    while (n > 16) {                                                           \
+      if (depth-- == 0) {                                                      \
+        NAME##_heapsort(base, n, criteria);                                    \
+        return;                                                                \
+      }                                                                        \
+                                                                               \
+      DATA_TYPE *first = base, *middle = base + n / 2, *last = base + n - 1;   \
+      DATA_TYPE tmp;                                                           \
+                                                                               \
+      /* Median of three, the middle ends up in *middle */                     \
+      if (CRITERIA(middle, first) < 0) {                                       \
+        tmp = *middle;                                                         \
+        *middle = *first;                                                      \
+        *first = tmp;                                                          \
+      }                                                                        \
+                                                                               \
+      if (CRITERIA(last, middle) < 0) {                                        \
+        tmp = *last;                                                           \
+        *last = *middle;                                                       \
+        *middle = tmp;                                                         \
+                                                                               \
+        if (CRITERIA(middle, first) < 0) {                                     \
+          tmp = *middle;                                                       \
+          *middle = *first;                                                    \
+          *first = tmp;                                                        \
+        }                                                                      \
+      }                                                                        \
+                                                                               \
+      const DATA_TYPE pivot = *middle;                                         \
+      size_t i = 0, j = n - 1;                                                 \
+                                                                               \
+      /* Hoare partition: [0, j] <= pivot <= [j + 1, n) */                     \
+      for (;;) {                                                               \
+        while (CRITERIA(&base[i], &pivot) < 0)                                 \
+          i++;                                                                 \
+                                                                               \
+        while (CRITERIA(&pivot, &base[j]) < 0)                                 \
+          j--;                                                                 \
+                                                                               \
+        if (i >= j)                                                            \
+          break;                                                               \
+                                                                               \
+        tmp = base[i];                                                         \
+        base[i++] = base[j];                                                   \
+        base[j--] = tmp;                                                       \
+      }                                                                        \
+                                                                               \
+      /* Recurse into the smaller half so the stack stays logarithmic */       \
+      if (j + 1 < n - (j + 1)) {                                               \
+        NAME##_loop(base, j + 1, depth, criteria);                             \
+        base += j + 1;                                                         \
+        n -= j + 1;                                                            \
+      } else {                                                                 \
+        NAME##_loop(base + j + 1, n - (j + 1), depth, criteria);               \
+        n = j + 1;                                                             \
+      }                                                                        \
+    }                                                                          \
+                                                                               \
+    NAME##_insertion(base, n, criteria);                                       \
+  }                                                                            \
+                                                                               \
+  static inline void NAME(DATA_TYPE *base, size_t n,                           \
+                          int (*criteria)(DATA_TYPE const *,                   \
+                                          DATA_TYPE const *)) {                \
+    size_t depth = 0;                                                          \
+                                                                               \
+    for (size_t m = n; m > 1; m >>= 1)                                         \
+      depth += 2;                                                              \
+                                                                               \
+    NAME##_loop(base, n, depth, criteria);                                     \
+  }
+
+// garray_TYPE_sort() and garray_TYPE_sort_inplace() on top of the typed sort
+#define ___GARRAY_SORT(DATA_TYPE, LINKAGE)                                     \
+  ___GARRAY_SORT_ENGINE(___garray_##DATA_TYPE##_introsort, DATA_TYPE,          \
+                        criteria)                                              \
+                                                                               \
+  LINKAGE void garray_##DATA_TYPE##_sort_inplace(                              \
+      garray_##DATA_TYPE a,                                                    \
+      int criteria(DATA_TYPE const *, DATA_TYPE const *)) {                    \
+    DATA_TYPE *elements = (DATA_TYPE *)___garray_flatten(a);                   \
+                                                                               \
+    ___garray_##DATA_TYPE##_introsort(elements, a->num_elements, criteria);    \
+    ___garray_unflatten(a, elements);                                          \
+  }                                                                            \
+                                                                               \
+  LINKAGE garray_##DATA_TYPE garray_##DATA_TYPE##_sort(                        \
+      garray_##DATA_TYPE a,                                                    \
+      int criteria(DATA_TYPE const *, DATA_TYPE const *)) {                    \
+    a = ___garray_clone(a);                                                    \
+    garray_##DATA_TYPE##_sort_inplace(a, criteria);                            \
+    return a;                                                                  \
+  }                                                                            \
+                                                                               \
+  static inline void ___garray_##DATA_TYPE##_sort_chunk(                       \
+      void *base, size_t num_elements,                                         \
+      int criteria(void const *, void const *)) {                              \
+    ___garray_##DATA_TYPE##_introsort(                                         \
+        (DATA_TYPE *)base, num_elements,                                       \
+        (int (*)(DATA_TYPE const *, DATA_TYPE const *))criteria);              \
+  }                                                                            \
+                                                                               \
+  LINKAGE garray_##DATA_TYPE garray_##DATA_TYPE##_sort_parallel(               \
+      garray_##DATA_TYPE a,                                                    \
+      int criteria(DATA_TYPE const *, DATA_TYPE const *),                      \
+      unsigned num_threads) {                                                  \
+    return ___garray_sort_parallel(                                            \
+        a, (int (*)(void const *, void const *))criteria, num_threads,         \
+        ___garray_##DATA_TYPE##_sort_chunk);                                   \
+  }                                                                            \
+                                                                               \
+  LINKAGE garray_##DATA_TYPE garray_##DATA_TYPE##_sort_radix(                  \
+      garray_##DATA_TYPE a, enum garray_radix_key key, size_t key_offset) {    \
+    return ___garray_sort_radix(a, key, key_offset);                           \
+  }                                                                            \
+                                                                               \
+  LINKAGE garray_##DATA_TYPE garray_##DATA_TYPE##_sort_radix_by(               \
+      garray_##DATA_TYPE a, uint64_t key(DATA_TYPE const *element)) {          \
+    return ___garray_sort_radix_by(a,                                          \
+                                   (uint64_t (*)(void const *))key);           \
+  }
+
+// Hot path functions that access the array directly as an array of DATA_TYPE,
+// they only call the untyped functions on the slow paths
+#define ___GARRAY_INLINE_HOT(DATA_TYPE)                                        \
+  static inline garray_index garray_##DATA_TYPE##_add(garray_##DATA_TYPE a,    \
+                                                      DATA_TYPE data) {        \
+    /* The writers of a concurrent array claim positions atomically */         \
+    if (a->concurrent != NULL)                                                 \
+      return ___garray_add(a, &data);                                          \
+                                                                               \
+    garray_index pos = a->next_free;                                           \
+                                                                               \
+    if (a->dense) {                                                            \
+      if (pos < a->capacity) {                                                 \
+        ((DATA_TYPE *)a->array)[pos] = data;                                   \
+        a->num_elements++;                                                     \
+        a->next_free++;                                                        \
+        return pos;                                                            \
+      }                                                                        \
+    } else if (pos < a->capacity) {                                            \
+      garray_word *word = &a->values_setted[pos >> GARRAY_LOG_B2_WORD_BITS];   \
+      garray_word bit = (garray_word)1 << (pos % GARRAY_WORD_BITS);            \
+                                                                               \
+      /* A word that becomes full has to be marked in full_summary */          \
+      if (!(*word & bit) && (*word | bit) != GARRAY_WORD_FULL) {               \
+        *(DATA_TYPE *)___garray_slot(a, pos, sizeof(DATA_TYPE)) = data;        \
+        *word |= bit;                                                          \
+        a->num_elements++;                                                     \
+        a->next_free++;                                                        \
+        return pos;                                                            \
+      }                                                                        \
+    }                                                                          \
+                                                                               \
+    return ___garray_add(a, &data);                                            \
+  }                                                                            \
+                                                                               \
+  static inline DATA_TYPE const *garray_##DATA_TYPE##_at(                      \
+      garray_##DATA_TYPE a, garray_index position) {                           \
+    /* The readers of a concurrent array may race a grow */                    \
+    if (a->concurrent != NULL)                                                 \
+      return (DATA_TYPE const *)___garray_at(a, position);                     \
+                                                                               \
+    if (a->dense ? position < a->num_elements                                  \
+                 : position < a->capacity &&                                   \
+                       (a->values_setted[position >>                           \
+                                         GARRAY_LOG_B2_WORD_BITS] >>           \
+                        (position % GARRAY_WORD_BITS)) &                       \
+                           1)                                                  \
+      return (DATA_TYPE const *)___garray_slot(a, position,                    \
+                                               sizeof(DATA_TYPE));             \
+                                                                               \
+    return ___garray_at(a, position); /* Aborts */                             \
+  }                                                                            \
+                                                                               \
+  static inline DATA_TYPE const *garray_##DATA_TYPE##_at_default(              \
+      garray_##DATA_TYPE a, garray_index position,                             \
+      DATA_TYPE const *default_value) {                                        \
+    if (a->paged || a->concurrent != NULL)                                     \
+      return (DATA_TYPE const *)___garray_at_default(a, position,              \
+                                                     default_value);           \
+                                                                               \
+    if (a->dense ? position < a->num_elements                                  \
+                 : position < a->capacity &&                                   \
+                       (a->values_setted[position >>                           \
+                                         GARRAY_LOG_B2_WORD_BITS] >>           \
+                        (position % GARRAY_WORD_BITS)) &                       \
+                           1)                                                  \
+      return (DATA_TYPE const *)___garray_slot(a, position,                    \
+                                               sizeof(DATA_TYPE));             \
+                                                                               \
+    return default_value;                                                      \
+  }                                                                            \
+                                                                               \
+  static inline void garray_##DATA_TYPE##_set(                                 \
+      garray_##DATA_TYPE a, garray_index position, DATA_TYPE data) {           \
+    if (a->concurrent != NULL) {                                               \
+      ___garray_set(a, position, &data);                                       \
+      return;                                                                  \
+    }                                                                          \
+                                                                               \
+    if (a->dense) {                                                            \
+      if (position < a->num_elements) {                                        \
+        ((DATA_TYPE *)a->array)[position] = data;                              \
+        return;                                                                \
+      }                                                                        \
+    } else if (position < a->capacity) {                                       \
+      garray_word *word =                                                      \
+          &a->values_setted[position >> GARRAY_LOG_B2_WORD_BITS];              \
+      garray_word bit = (garray_word)1 << (position % GARRAY_WORD_BITS);       \
+                                                                               \
+      if (*word & bit) {                                                       \
+        *(DATA_TYPE *)___garray_slot(a, position, sizeof(DATA_TYPE)) = data;   \
+        return;                                                                \
+      }                                                                        \
+                                                                               \
+      if ((*word | bit) != GARRAY_WORD_FULL) {                                 \
+        *(DATA_TYPE *)___garray_slot(a, position, sizeof(DATA_TYPE)) = data;   \
+        *word |= bit;                                                          \
+        a->num_elements++;                                                     \
+        return;                                                                \
+      }                                                                        \
+    }                                                                          \
+                                                                               \
+    ___garray_set(a, position, &data);                                         \
+  }                                                                            \
+                                                                               \
+  static inline bool garray_##DATA_TYPE##_iter_condition(                      \
+      garray_##DATA_TYPE##_iter iterator) {                                    \
+    return ((garray_iter)iterator)->valid_index;                               \
+  }                                                                            \
+                                                                               \
+  static inline void garray_##DATA_TYPE##_iter_next(                           \
+      garray_##DATA_TYPE##_iter iterator) {                                    \
+    garray_iter it = (garray_iter)iterator;                                    \
+                                                                               \
+    if (it->garray->paged || it->garray->concurrent != NULL) {                 \
+      ___garray_iter_next(it);                                                 \
+      return;                                                                  \
+    }                                                                          \
+                                                                               \
+    const garray_index max_index = it->garray->capacity;                       \
+    garray_index from = it->index + 1;                                         \
+                                                                               \
+    if (it->garray->dense && it->index < max_index) {                          \
+      it->valid_index = from < it->garray->num_elements;                       \
+      it->index = it->valid_index ? from : max_index;                          \
+      return;                                                                  \
+    }                                                                          \
+                                                                               \
+    if (it->index >= max_index || from >= max_index) {                         \
+      it->index = it->index >= max_index ? it->index : max_index;              \
+      it->valid_index = false;                                                 \
+      return;                                                                  \
+    }                                                                          \
+                                                                               \
+    const garray_index last_word = (max_index - 1) >> GARRAY_LOG_B2_WORD_BITS; \
+    garray_index word = from >> GARRAY_LOG_B2_WORD_BITS;                       \
+    garray_word bits = it->garray->values_setted[word] &                       \
+                       (GARRAY_WORD_FULL << (from % GARRAY_WORD_BITS));        \
+                                                                               \
+    while (bits == 0) {                                                        \
+      if (++word > last_word) {                                                \
+        it->index = max_index;                                                 \
+        it->valid_index = false;                                               \
+        return;                                                                \
+      }                                                                        \
+                                                                               \
+      bits = it->garray->values_setted[word];                                  \
+    }                                                                          \
+                                                                               \
+    from = (word << GARRAY_LOG_B2_WORD_BITS) + GARRAY_CTZ(bits);               \
+    it->valid_index = from < max_index;                                        \
+    it->index = it->valid_index ? from : max_index;                            \
+  }                                                                            \
+                                                                               \
+  static inline DATA_TYPE const *garray_##DATA_TYPE##_iter_get(                \
+      garray_##DATA_TYPE##_iter iterator) {                                    \
+    garray_iter it = (garray_iter)iterator;                                    \
+                                                                               \
+    if (it->garray->paged || it->garray->concurrent != NULL)                   \
+      return (DATA_TYPE const *)___garray_iter_get(it);                        \
+                                                                               \
+    return (DATA_TYPE const *)___garray_slot(it->garray, it->index,            \
+                                             sizeof(DATA_TYPE));               \
+  }
+
+// Implement the array for the type DATA_TYPE --------------------------------
+#define GARRAY_IMPLEMENT(DATA_TYPE)                                            \
+  typedef struct generic_array *garray_##DATA_TYPE;                            \
+  typedef struct generic_array_iter *garray_##DATA_TYPE##_iter;                \
+                                                                               \
+  ___GARRAY_CORE                                                               \
+                                                                               \
+  ___GARRAY_FORWARD_HOT(DATA_TYPE, extern inline)                              \
+                                                                               \
+  ___GARRAY_FORWARD_COLD(DATA_TYPE, extern inline)                             \
+                                                                               \
+  ___GARRAY_SORT(DATA_TYPE, extern inline)
+
+// Implement the array for the type DATA_TYPE as static inline functions, the
+// hot paths access the array directly. Used instead of GARRAY_DECLARE() and
+// GARRAY_IMPLEMENT() in every module that uses the array
+#define GARRAY_IMPLEMENT_INLINE(DATA_TYPE)                                     \
+  typedef struct generic_array *garray_##DATA_TYPE;                            \
+  typedef struct generic_array_iter *garray_##DATA_TYPE##_iter;                \
+                                                                               \
+  ___GARRAY_CORE                                                               \
+                                                                               \
+  ___GARRAY_INLINE_HOT(DATA_TYPE)                                              \
+                                                                               \
+  ___GARRAY_FORWARD_COLD(DATA_TYPE, static inline)                             \
+                                                                               \
+  ___GARRAY_SORT(DATA_TYPE, static inline)
+
+// Generates garray_TYPE_sort_NAME(a) and garray_TYPE_sort_inplace_NAME(a), that
+// work as garray_TYPE_sort() and garray_TYPE_sort_inplace() with CRITERIA as
+// criteria. CRITERIA is known at compile time so it can be inlined in the sort.
+// Used after GARRAY_IMPLEMENT() or GARRAY_IMPLEMENT_INLINE() in every module
+// that uses it
+#define GARRAY_IMPLEMENT_SORT(DATA_TYPE, NAME, CRITERIA)                       \
+  ___GARRAY_CORE                                                               \
+                                                                               \
+  ___GARRAY_SORT_ENGINE(___garray_##DATA_TYPE##_introsort_##NAME, DATA_TYPE,   \
+                        CRITERIA)                                              \
+                                                                               \
+  static inline void garray_##DATA_TYPE##_sort_inplace_##NAME(                 \
+      garray_##DATA_TYPE a) {                                                  \
+    DATA_TYPE *elements = (DATA_TYPE *)___garray_flatten(a);                   \
+                                                                               \
+    ___garray_##DATA_TYPE##_introsort_##NAME(elements, a->num_elements, NULL); \
+    ___garray_unflatten(a, elements);                                          \
+  }                                                                            \
+                                                                               \
+  static inline garray_##DATA_TYPE garray_##DATA_TYPE##_sort_##NAME(           \
+      garray_##DATA_TYPE a) {                                                  \
+    a = ___garray_clone(a);                                                    \
+    garray_##DATA_TYPE##_sort_inplace_##NAME(a);                               \
+    return a;                                                                  \
   }
 
 #endif
@@ -1,11 +1,15 @@
-#include <stdio.h>
-
 #include "garray.c"
 #include "garray.h"
 
+#include <pthread.h>
+#include <stdio.h>
+
 GARRAY_DECLARE(int)
 GARRAY_IMPLEMENT(int)
 
+typedef int int_inline;
+GARRAY_IMPLEMENT_INLINE(int_inline)
+
 void print_garray_int(garray_int a)
 {
     if (garray_int_size(a) == 0) {
@@ -18,20 +22,20 @@ void print_garray_int(garray_int a)
     printf("[%i", *garray_int_at_default(a, 0, &defaultv));
 
     if (garray_int_size(a) == 1) {
-        printf("][%i]\n", GARRAY_GET_VALUE_SETTED(a, 0));
+        printf("][%i]\n", GARRAY_GET_VALUE_SETTED(a, 0) ? 1 : 0);
         return;
     }
 
-    garray_int_iter it = garray_int_iter_new(a);
+    struct generic_array_iterator storage;
+    garray_int_iter it = garray_int_iter_init(a, &storage);
 
-    for (garray_int_iter_next(it); garray_int_iter_condition_free(it);
+    for (garray_int_iter_next(it); garray_int_iter_condition(it);
          garray_int_iter_next(it))
         printf(", %i", *garray_int_iter_get(it));
 
     printf("][");
 
-    for (garray_index i = 0; i < a->bytes_allocated / a->element_size;
-         i++)
+    for (garray_index i = 0; i < a->capacity; i++)
         printf("%i", GARRAY_GET_VALUE_SETTED(a, i) ? 1 : 0);
 
     printf("]\n");
@@ -49,12 +53,78 @@ int_descending(int const* left, int const* right)
     return *right - *left;
 }
 
+GARRAY_IMPLEMENT_SORT(int, descending, int_descending)
+
+bool
+int_equal(int const* left, int const* right)
+{
+    return *left == *right;
+}
+
 bool
 even(int const* element, void* data)
 {
     return *element % 2 == 0;
 }
 
+void*
+add_thousands(void* array)
+{
+    for (int i = 0; i < 10000; i++)
+        garray_int_add(array, i);
+
+    return NULL;
+}
+
+/* Adds 10000 elements through the inline hot paths, then doubles each of them in place */
+static void*
+add_and_set_inline(void* array)
+{
+    garray_index positions[10000];
+
+    for (int i = 0; i < 10000; i++)
+        positions[i] = garray_int_inline_add(array, i);
+    for (int i = 0; i < 10000; i++)
+        garray_int_inline_set(array, positions[i], 2 * i);
+
+    return NULL;
+}
+
+static void*
+add_inline(void* array)
+{
+    for (int i = 0; i < 10000; i++)
+        garray_int_inline_add(array, i);
+
+    return NULL;
+}
+
+/* Reads through the inline hot paths while other threads grow the array, counts the elements out of range */
+static void*
+read_inline(void* array)
+{
+    intptr_t wrong = 0;
+
+    for (int pass = 0; pass < 4; pass++) {
+        for (garray_index i = 0; i < 20000; i++) {
+            int_inline const* value = garray_int_inline_at_default(array, i, NULL);
+
+            wrong += value != NULL && (*value < 0 || *value >= 10000);
+        }
+
+        GARRAY_FOREACH(int_inline, array, value)
+            wrong += *value < 0 || *value >= 10000;
+    }
+
+    return (void*)wrong;
+}
+
+static void*
+add_to_shard(void* sharded)
+{
+    return add_thousands(garray_int_sharded_shard(sharded));
+}
+
 int
 main()
 {
@@ -71,7 +141,7 @@ main()
     garray_int_add(ai, 8);
     garray_int_add(ai, 9);
     printf("Array int -> Size:%i Allocated:%i\n", ai->num_elements,
-           ai->bytes_allocated);
+           (int)(ai->capacity * ai->element_size));
 
     print_garray_int(ai);
 
@@ -112,11 +182,55 @@ main()
     garray_int_add(ai, 22);
     garray_int_add(ai, 23);
 
+    garray_int_sort_inplace_descending(ai);
+    printf("sorted descending in place: ");
+    print_garray_int(ai);
+
+    garray_int_sort_inplace(ai, int_ascending);
+    printf("sorted ascending in place: ");
+    print_garray_int(ai);
+
+    ai_s = garray_int_sort_radix(ai2 = garray_int_sort(ai, int_descending), GARRAY_RADIX_I32, 0);
+    garray_int_free(ai2);
+    printf("radix sorted: ");
+    print_garray_int(ai_s);
+    garray_int_free(ai_s);
+
+    ai_s = garray_int_sort_parallel(ai, int_descending, 4);
+    printf("parallel sorted descending: ");
+    print_garray_int(ai_s);
+    garray_int_free(ai_s);
+
     garray_int int_query = garray_int_query(ai, NULL, even);
     printf("only even: ");
     print_garray_int(int_query);
     garray_int_free(int_query);
 
+    garray_pool pool = garray_pool_new(3);
+    int_query = garray_int_query_parallel(ai, NULL, even, pool);
+    printf("only even in parallel: ");
+    print_garray_int(int_query);
+    garray_int_free(int_query);
+    garray_pool_free(pool);
+
+    printf("contains 12: %i, contains 15: %i\n", garray_int_contains(ai, 12, int_equal),
+           garray_int_contains(ai, 15, int_equal));
+
+    printf("foreach until the first over 10, skipping odd:");
+
+    GARRAY_FOREACH(int, ai, value)
+    {
+        if (*value > 10)
+            break;
+
+        if (*value % 2 != 0)
+            continue;
+
+        printf(" %i", *value);
+    }
+
+    printf("\n");
+
     printf("added three elements: ");
     print_garray_int(ai);
 
@@ -131,8 +245,387 @@ main()
     printf("collapse: ");
     print_garray_int(ai);
 
+    garray_int stable = garray_int_new();
+
+    for (int i = 0; i < 10; i++)
+        garray_int_add(stable, i);
+
+    garray_int_remove(stable, 1);
+    garray_int_remove(stable, 4);
+    garray_int_remove(stable, 5);
+    garray_int_compact(stable);
+    printf("compact: ");
+    print_garray_int(stable);
+
+    garray_int_remove(stable, 0);
+    garray_int_remove(stable, 3);
+    printf("compact steps: %i", garray_int_compact_step(stable, 2));
+    printf(" %i, ", garray_int_compact_step(stable, 10));
+    print_garray_int(stable);
+
+    garray_int_set_auto_compaction(stable, 0.2, 8);
+    garray_int_remove(stable, 1);
+    printf("auto compacted: ");
+    print_garray_int(stable);
+
+    for (int i = 10; i < 20; i++)
+        garray_int_add(stable, i);
+
+    garray_int_remove_range(stable, 1, 5);
+    printf("auto compacted range: ");
+    print_garray_int(stable);
+    garray_int_free(stable);
+
+    /* Several words of values_setted go through the compress kernels, holes are denser than 1/32 */
+    garray_int holey = garray_int_new();
+
+    for (int i = 0; i < 1000; i++)
+        garray_int_add(holey, i);
+    for (garray_index i = 0; i < 1000; i += 3)
+        garray_int_remove(holey, i);
+
+    garray_int holey_even = garray_int_query(holey, NULL, even);
+    long long holey_sum = 0;
+    GARRAY_FOREACH(int, holey_even, value)
+        holey_sum += *value;
+
+    printf("holey: query size %u, at 0: %i, at 332: %i, sum %lli", garray_int_size(holey_even),
+           *garray_int_at(holey_even, 0), *garray_int_at(holey_even, 332), holey_sum);
+    garray_int_collapse(holey);
+    printf(", collapsed size %u, at 0: %i, at 100: %i, at 665: %i\n", garray_int_size(holey), *garray_int_at(holey, 0),
+           *garray_int_at(holey, 100), *garray_int_at(holey, 665));
+
+    garray_int_free(holey_even);
+    garray_int_free(holey);
+
+    int bulk[] = { 100, 101, 102, 103, 104 };
+    garray_index bulk_positions[] = { 12, 1, 0 };
+    int gathered[3];
+
+    garray_int_remove_range(ai, 2, 3);
+    printf("removed range [2, 5): ");
+    print_garray_int(ai);
+
+    printf("spans:");
+
+    int const* span;
+
+    for (garray_index position = 0, length;
+         (length = garray_int_next_span(ai, &position, &span)) != 0; position += length)
+        printf(" %u..%u starting with %i", position, position + length - 1, *span);
+
+    printf("\n");
+
+    garray_int_add_many(ai, bulk, 5);
+    printf("added five elements at once: ");
+    print_garray_int(ai);
+
+    garray_int_set_range(ai, 14, bulk, 3);
+    printf("setted range [14, 17): ");
+    print_garray_int(ai);
+
+    garray_int_at_many(ai, bulk_positions, 3, gathered);
+    printf("at 12, 1 and 0: %i %i %i\n", gathered[0], gathered[1], gathered[2]);
+
     garray_int_free(ai);
 
+    garray_int_inline ii = garray_int_inline_new();
+
+    for (int i = 0; i < 70; i++)
+        garray_int_inline_add(ii, i);
+
+    garray_int_inline_remove(ii, 3);
+    garray_int_inline_set(ii, 3, 33);
+    garray_int_inline_remove(ii, 64);
+    garray_int_inline_add(ii, 640);
+
+    printf("inline: size %u, at 3: %i, at 64: %i, sum: ", garray_int_inline_size(ii),
+           *garray_int_inline_at(ii, 3), *garray_int_inline_at(ii, 64));
+
+    int sum = 0;
+
+    for (garray_int_inline_iter iit = garray_int_inline_iter_new(ii);
+         garray_int_inline_iter_condition_free(iit); garray_int_inline_iter_next(iit))
+        sum += *garray_int_inline_iter_get(iit);
+
+    printf("%i\n", sum);
+
+    garray_int_inline_free(ii);
+
+    garray_arena arena = garray_arena_new(1024);
+    garray_int in_arena = garray_int_new_with_allocator(garray_arena_allocator(arena));
+
+    for (int i = 0; i < 100; i++)
+        garray_int_add(in_arena, i * i);
+
+    /* The policy is allocated in the arena too, resetting it frees everything */
+    garray_int_set_auto_compaction(in_arena, 0.5, 16);
+    garray_int_remove_range(in_arena, 3, 90);
+    int_query = garray_int_query(in_arena, NULL, even);
+    printf("even squares in an arena: ");
+    print_garray_int(int_query);
+    garray_arena_reset(arena);
+    garray_arena_free(arena);
+
+    garray_int dense = garray_int_new_dense();
+
+    for (int i = 0; i < 10; i++)
+        garray_int_add(dense, i);
+
+    garray_int_remove(dense, 2);
+    garray_int_set(dense, 0, 100);
+    garray_int_remove_range(dense, 4, 2);
+    garray_int_collapse(dense);
+
+    printf("dense:");
+    GARRAY_FOREACH(int, dense, value)
+        printf(" %i", *value);
+    printf(", at 8: %i\n", *garray_int_at_default(dense, 8, &(int){-1}));
+
+    garray_int_free(dense);
+
+    garray_int paged = garray_int_new_paged();
+
+    garray_int_set(paged, 3000000000u, 3);
+    garray_int_set(paged, 1000000000, 1);
+    garray_int_set(paged, 7, 0);
+    garray_int_set(paged, 1000000001, 2);
+    garray_int_remove(paged, 1000000001);
+    garray_int_add(paged, 10);
+
+    printf("paged: size %u, at 1000000000: %i, at 1000000001: %i, in order:", garray_int_size(paged),
+           *garray_int_at(paged, 1000000000), *garray_int_at_default(paged, 1000000001, &(int){-1}));
+    GARRAY_FOREACH(int, paged, value)
+        printf(" %i", *value);
+    printf("\n");
+
+    garray_int paged_clone = garray_int_clone(paged);
+
+    garray_int_set(paged_clone, 7, 70);
+    garray_int_remove(paged_clone, 3000000000u);
+    printf("paged clone: at 7: %i, size %u, original at 7: %i, size %u\n", *garray_int_at(paged_clone, 7),
+           garray_int_size(paged_clone), *garray_int_at(paged, 7), garray_int_size(paged));
+    garray_int_free(paged_clone);
+
+    garray_int_collapse(paged);
+    printf("paged collapsed:");
+    for (garray_index i = 0; i < garray_int_size(paged); i++)
+        printf(" %i", *garray_int_at(paged, i));
+    printf("\n");
+
+    garray_int_free(paged);
+
+    garray_int segmented = garray_int_new_segmented();
+
+    int const* first = garray_int_at(segmented, garray_int_add(segmented, 42));
+
+    for (int i = 1; i < 100000; i++)
+        garray_int_add(segmented, i);
+    garray_int_remove(segmented, 17);
+
+    printf("segmented: size %u, first did not move: %i, at 16: %i, at 17: %i, at 99999: %i\n",
+           garray_int_size(segmented), first == garray_int_at(segmented, 0) && *first == 42,
+           *garray_int_at(segmented, 16), *garray_int_at_default(segmented, 17, &(int){-1}),
+           *garray_int_at(segmented, 99999));
+
+    garray_int_free(segmented);
+
+    /* The byte offset of 2^30 ints does not fit in 32 bits, bounds are checked in elements */
+    garray_int small = garray_int_new();
+
+    garray_int_add(small, 1);
+    printf("at 2^30 of a small array: %i\n", *garray_int_at_default(small, (garray_index)1 << 30, &(int){-1}));
+
+    garray_int_free(small);
+
+    /* 4 MB of ints are past GARRAY_MMAP_THRESHOLD, collapsing moves them back to malloc() */
+    garray_int large = garray_int_new();
+
+    for (int i = 0; i < 1 << 20; i++)
+        garray_int_add(large, i);
+    garray_int_set(large, 3 << 20, 3);
+
+    printf("large: size %u, at 999999: %i, at 3M: %i", garray_int_size(large), *garray_int_at(large, 999999),
+           *garray_int_at(large, 3 << 20));
+
+    garray_int_remove_range(large, 10, 1 << 20);
+    garray_int_collapse(large);
+
+    printf(", collapsed: size %u, at 10: %i\n", garray_int_size(large), *garray_int_at(large, 10));
+
+    garray_int_free(large);
+
+    /* Collapsing within a mapping keeps it, growing it again must not find the old bits past its new size */
+    garray_int remapped = garray_int_new();
+
+    for (int i = 0; i < 1100000; i++)
+        garray_int_add(remapped, i);
+
+    garray_int_remove_range(remapped, 512000, 1100000);
+    garray_int_collapse(remapped);
+
+    for (int i = 0; i < 10; i++)
+        garray_int_add(remapped, -i);
+
+    garray_index remapped_visited = 0;
+    long long remapped_sum = 0;
+    GARRAY_FOREACH(int, remapped, value) {
+        remapped_visited++;
+        remapped_sum += *value;
+    }
+
+    printf("remapped: size %u, visited %u, sum %lli, at 600000: %i\n", garray_int_size(remapped), remapped_visited,
+           remapped_sum, *garray_int_at_default(remapped, 600000, &(int){-1}));
+
+    garray_int_free(remapped);
+
+    garray_int saved = garray_int_new();
+
+    for (int i = 0; i < 20; i++)
+        garray_int_add(saved, i * 10);
+    garray_int_remove(saved, 3);
+
+    printf("saved: %i", garray_save(saved, "test.garray"));
+    garray_int_free(saved);
+
+    garray_int mapped = garray_int_open_mmap("test.garray", GARRAY_MAP_SHARED);
+
+    printf(", opened: size %u, at 4: %i, at 3: %i", garray_int_size(mapped), *garray_int_at(mapped, 4),
+           *garray_int_at_default(mapped, 3, &(int){-1}));
+
+    garray_int_set(mapped, 3, 33);
+    garray_int_set(mapped, 100, 1000);
+    garray_int_free(mapped);
+
+    mapped = garray_int_open_mmap("test.garray", GARRAY_MAP_READONLY);
+    printf(", reopened: size %u, at 3: %i, at 100: %i\n", garray_int_size(mapped), *garray_int_at(mapped, 3),
+           *garray_int_at(mapped, 100));
+    garray_int_free(mapped);
+    remove("test.garray");
+
+    garray_int written = garray_int_new(), paged_written = garray_int_new_paged();
+    FILE* stream = tmpfile();
+
+    for (int i = 0; i < 1000; i++)
+        garray_int_add(written, i);
+    garray_int_remove_range(written, 10, 980);
+    garray_int_set(paged_written, 3000000000u, 3);
+
+    printf("written: %i", garray_write(written, stream));
+    printf(" %i", garray_write(paged_written, stream));
+    garray_int_free(written);
+    garray_int_free(paged_written);
+
+    printf(", stream of %li bytes", ftell(stream));
+    rewind(stream);
+    written = garray_int_read(stream);
+    paged_written = garray_int_read(stream);
+
+    printf(", read: size %u, at 9: %i, at 10: %i, at 999: %i, paged at 3G: %i", garray_int_size(written),
+           *garray_int_at(written, 9), *garray_int_at_default(written, 10, &(int){-1}), *garray_int_at(written, 999),
+           *garray_int_at(paged_written, 3000000000u));
+    printf(", past the end: %i\n", garray_int_read(stream) == NULL);
+
+    garray_int_free(written);
+    garray_int_free(paged_written);
+    fclose(stream);
+
+    garray_int concurrent = garray_int_new_concurrent();
+    pthread_t adders[4];
+
+    for (int i = 0; i < 4; i++)
+        pthread_create(&adders[i], NULL, add_thousands, concurrent);
+    for (int i = 0; i < 4; i++)
+        pthread_join(adders[i], NULL);
+
+    long long concurrent_sum = 0;
+    GARRAY_FOREACH(int, concurrent, value)
+        concurrent_sum += *value;
+
+    printf("concurrent: size %u, sum %lli", garray_int_size(concurrent), concurrent_sum);
+    garray_int_remove(concurrent, 7);
+    printf(", added at %u after removing 7\n", garray_int_add(concurrent, 1));
+
+    garray_int_free(concurrent);
+
+    garray_int_inline concurrent_inline = garray_int_inline_new_concurrent();
+
+    for (int i = 0; i < 4; i++)
+        pthread_create(&adders[i], NULL, add_and_set_inline, concurrent_inline);
+    for (int i = 0; i < 4; i++)
+        pthread_join(adders[i], NULL);
+
+    long long concurrent_inline_sum = 0;
+    GARRAY_FOREACH(int_inline, concurrent_inline, value)
+        concurrent_inline_sum += *value;
+
+    printf("concurrent inline: size %u, sum %lli\n", garray_int_inline_size(concurrent_inline),
+           concurrent_inline_sum);
+
+    garray_int_inline_free(concurrent_inline);
+
+    concurrent_inline = garray_int_inline_new_concurrent();
+    void* wrong_reads;
+
+    pthread_create(&adders[0], NULL, add_inline, concurrent_inline);
+    pthread_create(&adders[1], NULL, add_inline, concurrent_inline);
+    pthread_create(&adders[2], NULL, read_inline, concurrent_inline);
+    for (int i = 0; i < 3; i++)
+        pthread_join(adders[i], i == 2 ? &wrong_reads : NULL);
+
+    printf("concurrent inline reader: size %u, wrong reads %li, at 19999: %i\n",
+           garray_int_inline_size(concurrent_inline), (long)(intptr_t)wrong_reads,
+           *garray_int_inline_at(concurrent_inline, 19999));
+
+    garray_int_inline_free(concurrent_inline);
+
+    /* Bulk sets and reads grow a concurrent array outside of its writers, removes must still reach there */
+    garray_int bulk_concurrent = garray_int_new_concurrent();
+    int bulk_range[50];
+    FILE* concurrent_stream = tmpfile();
+
+    for (int i = 0; i < 50; i++)
+        bulk_range[i] = i;
+
+    garray_int_set_range(bulk_concurrent, 300, bulk_range, 50);
+    garray_int_remove(bulk_concurrent, 320);
+    printf("concurrent bulk: size %u, at 320: %i", garray_int_size(bulk_concurrent),
+           *garray_int_at_default(bulk_concurrent, 320, &(int){-1}));
+
+    garray_write(bulk_concurrent, concurrent_stream);
+    garray_int_free(bulk_concurrent);
+    rewind(concurrent_stream);
+    bulk_concurrent = garray_int_read(concurrent_stream);
+    garray_int_remove(bulk_concurrent, 349);
+    printf(", read: size %u, at 349: %i\n", garray_int_size(bulk_concurrent),
+           *garray_int_at_default(bulk_concurrent, 349, &(int){-1}));
+
+    garray_int_free(bulk_concurrent);
+    fclose(concurrent_stream);
+
+    garray_sharded sharded = garray_int_new_sharded();
+
+    for (int i = 0; i < 2; i++)
+        pthread_create(&adders[i], NULL, add_to_shard, sharded);
+    for (int i = 0; i < 2; i++)
+        pthread_join(adders[i], NULL);
+
+    garray_int snapshot = garray_int_sharded_snapshot(sharded);
+    garray_int merged = garray_int_sharded_merge(sharded);
+    garray_int emptied = garray_int_sharded_snapshot(sharded);
+    long long merged_sum = 0;
+    GARRAY_FOREACH(int, merged, value)
+        merged_sum += *value;
+
+    printf("sharded: snapshot size %u, merged size %u, sum %lli, at 10000: %i, after merge %u\n",
+           garray_int_size(snapshot), garray_int_size(merged), merged_sum, *garray_int_at(merged, 10000),
+           garray_int_size(emptied));
+
+    garray_int_free(snapshot);
+    garray_int_free(merged);
+    garray_int_free(emptied);
+    garray_sharded_free(sharded);
+
     garray_int a = garray_int_new();
 
     garray_int_iter it = garray_int_iter_new(a);